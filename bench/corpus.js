@@ -0,0 +1,114 @@
+"use strict";
+
+// Synthetic documents for the benchmarks.
+// They are generated deterministically, so that numbers from different
+// runs or different versions of libtidy can be compared.
+
+function Random(seed) {
+  this.state = seed >>> 0 || 1;
+}
+
+Random.prototype.next = function() { // xorshift32
+  let x = this.state;
+  x ^= x << 13;
+  x ^= x >>> 17;
+  x ^= x << 5;
+  this.state = x >>> 0;
+  return this.state;
+};
+
+Random.prototype.below = function(n) {
+  return this.next() % n;
+};
+
+Random.prototype.pick = function(arr) {
+  return arr[this.below(arr.length)];
+};
+
+const words = [
+  "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing",
+  "elit", "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore",
+  "et", "dolore", "magna", "aliqua", "&amp;", "&lt;tag&gt;", "café",
+];
+
+function text(rnd, n) {
+  const res = [];
+  for (let i = 0; i < n; ++i)
+    res.push(rnd.pick(words));
+  return res.join(" ");
+}
+
+function paragraph(rnd) {
+  switch (rnd.below(6)) {
+  case 0:
+    return `<h2>${text(rnd, 4)}</h2>\n`;
+  case 1:
+    return "<ul>\n" +
+      Array.from({length: 1 + rnd.below(5)},
+                 () => `<li>${text(rnd, 6)}</li>\n`).join("") +
+      "</ul>\n";
+  case 2:
+    return "<table>\n" +
+      Array.from({length: 1 + rnd.below(4)},
+                 () => `<tr><td>${text(rnd, 2)}</td>` +
+                   `<td class="num">${rnd.below(1000)}</td></tr>\n`).join("") +
+      "</table>\n";
+  default:
+    return `<p>${text(rnd, 10)} <a href="/page/${rnd.below(100)}">` +
+      `${text(rnd, 2)}</a> <b>${text(rnd, 3)}</b> ${text(rnd, 15)}</p>\n`;
+  }
+}
+
+function wellFormed(seed, paragraphs) {
+  const rnd = new Random(seed);
+  const body = [];
+  for (let i = 0; i < paragraphs; ++i)
+    body.push(paragraph(rnd));
+  return "<!DOCTYPE html>\n<html>\n<head>\n" +
+    "<meta charset=\"utf-8\">\n<title>Benchmark</title>\n</head>\n<body>\n" +
+    body.join("") + "</body>\n</html>\n";
+}
+
+// Typical tag soup: missing end tags, misnested inline elements,
+// unquoted and duplicate attributes, stray end tags, legacy markup
+function malformed(seed, paragraphs) {
+  const rnd = new Random(seed);
+  const body = [];
+  for (let i = 0; i < paragraphs; ++i) {
+    switch (rnd.below(6)) {
+    case 0:
+      body.push(`<p>${text(rnd, 8)} <b><i>${text(rnd, 3)}</b></i>\n`);
+      break;
+    case 1:
+      body.push(`<font color=red size=+1>${text(rnd, 5)}\n`);
+      break;
+    case 2:
+      body.push(`<table><td>${text(rnd, 2)}<td>${text(rnd, 2)}` +
+                `<tr><td>${text(rnd, 3)}</table>\n`);
+      break;
+    case 3:
+      body.push(`<div id=a id=b class="x>${text(rnd, 6)}</span></div>\n`);
+      break;
+    case 4:
+      body.push(`<li>${text(rnd, 4)}<li>${text(rnd, 4)}</ul>\n`);
+      break;
+    default:
+      body.push(`<p align=center>${text(rnd, 12)} <br> ${text(rnd, 4)}\n`);
+    }
+  }
+  return "<html><head><title>Benchmark</title><body>\n" + body.join("");
+}
+
+function entry(name, html) {
+  return {name: name, input: Buffer.from(html)};
+}
+
+// Returns a list of {name, input} objects, with input as a buffer
+module.exports = function corpus() {
+  return [
+    entry("small", wellFormed(1, 5)),
+    entry("medium", wellFormed(2, 500)),
+    entry("huge", wellFormed(3, 50000)),
+    entry("malformed", malformed(4, 500)),
+  ];
+};
@@ -0,0 +1,191 @@
+#!/usr/bin/env node
+
+"use strict";
+
+// Benchmarks for the various ways of tidying a document.
+//
+// Usage: node bench [options]
+//   --time <seconds>   minimal time spent on each combination, default 2
+//   --filter <regexp>  only run combinations whose name matches
+//   --compare          also run the htmltidy2 command line wrapper
+//   --json             print the results as JSON instead of a table
+//   --baseline <file>  compare against the JSON output of an earlier run
+
+const fs = require("fs");
+const libtidy = require("../");
+const corpus = require("./corpus");
+
+function parseArgs(args) {
+  const opts = {time: 2, filter: null, compare: false,
+                json: false, baseline: null};
+  for (let i = 0; i < args.length; ++i) {
+    const arg = args[i];
+    if (arg === "--compare") {
+      opts.compare = true;
+    } else if (arg === "--json") {
+      opts.json = true;
+    } else if (arg === "--time" && i + 1 < args.length) {
+      opts.time = Number(args[++i]);
+    } else if (arg === "--filter" && i + 1 < args.length) {
+      opts.filter = new RegExp(args[++i]);
+    } else if (arg === "--baseline" && i + 1 < args.length) {
+      opts.baseline = JSON.parse(fs.readFileSync(args[++i], "utf-8"));
+    } else {
+      console.error(`Unknown argument: ${arg}`);
+      process.exit(1);
+    }
+  }
+  return opts;
+}
+
+// Each implementation returns a promise,
+// resolving to the number of libtidy allocations if known
+const implementations = {
+
+  tidyBuffer: input => libtidy.tidyBuffer(input).then(res => {
+    let allocations = 0;
+    for (let phase in res.metrics)
+      allocations += res.metrics[phase].allocations;
+    return allocations;
+  }),
+
+  sync: input => new Promise(resolve => {
+    const doc = libtidy.TidyDoc();
+    doc.options = {newline: "LF"};
+    doc.parseBufferSync(input);
+    doc.cleanAndRepairSync();
+    doc.runDiagnosticsSync();
+    doc.saveBufferSync();
+    resolve(null);
+  }),
+
+  htmltidy: input => new Promise((resolve, reject) =>
+    libtidy.compat.htmltidy.tidy(input, (err, html) => {
+      if (err instanceof Error) reject(err);
+      else resolve(null);
+    })),
+
+};
+
+function htmltidy2() {
+  const tidy = require("htmltidy2").tidy;
+  return input => new Promise((resolve, reject) =>
+    tidy(input.toString(), (err, html) => {
+      if (err) reject(err);
+      else resolve(null);
+    }));
+}
+
+function elapsed(start) {
+  const diff = process.hrtime(start);
+  return diff[0] * 1e3 + diff[1] / 1e6; // milliseconds
+}
+
+function percentile(sorted, q) {
+  return sorted[Math.min(sorted.length - 1, Math.floor(q * sorted.length))];
+}
+
+// Runs one implementation on one document for at least the given time
+function measure(name, impl, doc, seconds) {
+  const latencies = [];
+  let allocations = null;
+  let peakRss = process.memoryUsage().rss;
+  let start;
+  function step() {
+    const t0 = process.hrtime();
+    return impl(doc.input).then(count => {
+      latencies.push(elapsed(t0));
+      if (count !== null)
+        allocations = (allocations || 0) + count;
+      peakRss = Math.max(peakRss, process.memoryUsage().rss);
+      if (elapsed(start) < seconds * 1e3 || latencies.length < 5)
+        return step();
+    });
+  }
+  // A few runs to warm up caches and the pool before measuring
+  return impl(doc.input).then(() => impl(doc.input)).then(() => {
+    start = process.hrtime();
+    return step();
+  }).then(() => {
+    const total = latencies.reduce((a, b) => a + b, 0);
+    const n = latencies.length;
+    latencies.sort((a, b) => a - b);
+    return {
+      name: name,
+      doc: doc.name,
+      size: doc.input.length,
+      runs: n,
+      docsPerSec: n / total * 1e3,
+      mbPerSec: n * doc.input.length / 1048576 / total * 1e3,
+      p50: percentile(latencies, 0.5),
+      p90: percentile(latencies, 0.9),
+      p99: percentile(latencies, 0.99),
+      peakRssMb: peakRss / 1048576,
+      allocations: allocations === null ? null : allocations / n,
+    };
+  });
+}
+
+function pad(str, width) {
+  str = String(str);
+  while (str.length < width) str = " " + str;
+  return str;
+}
+
+function fixed(num, digits) {
+  return num === null || num === undefined ? "-" : num.toFixed(digits);
+}
+
+function printTable(results, baseline) {
+  const header = ["implementation/doc", "docs/s", "MB/s", "p50 ms",
+                  "p90 ms", "p99 ms", "RSS MB", "allocs"];
+  if (baseline) header.push("vs base");
+  const rows = results.map(r => {
+    const row = [`${r.name}/${r.doc}`, fixed(r.docsPerSec, 1),
+                 fixed(r.mbPerSec, 2), fixed(r.p50, 3), fixed(r.p90, 3),
+                 fixed(r.p99, 3), fixed(r.peakRssMb, 1),
+                 fixed(r.allocations, 0)];
+    if (baseline) {
+      const base = baseline.find(b => b.name === r.name && b.doc === r.doc);
+      row.push(base ? fixed(r.docsPerSec / base.docsPerSec, 2) + "x" : "-");
+    }
+    return row;
+  });
+  const widths = header.map((h, i) => Math.max.apply(
+    Math, [h.length].concat(rows.map(row => row[i].length))));
+  [header].concat(rows).forEach(row => console.log(
+    row.map((cell, i) => i === 0 ? cell + " ".repeat(widths[0] - cell.length)
+            : pad(cell, widths[i])).join("  ")));
+}
+
+function main(args) {
+  const opts = parseArgs(args);
+  const impls = Object.assign({}, implementations);
+  if (opts.compare)
+    impls.htmltidy2 = htmltidy2();
+  const jobs = [];
+  for (let doc of corpus())
+    for (let name in impls)
+      if (!opts.filter || opts.filter.test(`${name}/${doc.name}`))
+        jobs.push({name: name, impl: impls[name], doc: doc});
+  const results = [];
+  return jobs.reduce((prev, job) => prev.then(() => {
+    if (!opts.json)
+      process.stderr.write(`${job.name}/${job.doc.name}...\n`);
+    return measure(job.name, job.impl, job.doc, opts.time)
+      .then(res => results.push(res));
+  }), Promise.resolve()).then(() => {
+    if (opts.json) {
+      console.log(JSON.stringify(results, null, 2));
+    } else {
+      console.log(`libtidy ${libtidy.libraryVersion}, ` +
+                  `node ${process.version}, ${process.platform}-${process.arch}`);
+      printTable(results, opts.baseline);
+    }
+  });
+}
+
+main(process.argv.slice(2)).catch(err => {
+  console.error(err.stack || err);
+  process.exit(1);
+});
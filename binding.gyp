@@ -4,10 +4,22 @@
             'target_name': '<(module_name)',
             'sources': [
                 'src/node-libtidy.cc',
+                'src/instance.cc',
                 'src/memory.cc',
+                'src/metrics.cc',
+                'src/cache.cc',
                 'src/opt.cc',
+                'src/messages.cc',
+                'src/tree.cc',
+                'src/extract.cc',
+                'src/fragments.cc',
+                'src/config.cc',
                 'src/doc.cc',
+                'src/stream.cc',
+                'src/file.cc',
                 'src/worker.cc',
+                'src/batch.cc',
+                'src/pool.cc',
                 'tidy-html5/src/access.c',
                 'tidy-html5/src/attrs.c',
                 'tidy-html5/src/istack.c',
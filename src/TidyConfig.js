@@ -0,0 +1,53 @@
+"use strict";
+
+var lib = require("./lib");
+var TidyConfig = lib.TidyConfig;
+module.exports = TidyConfig;
+
+// Augment native code by some JavaScript-written convenience methods
+
+// Jobs with higher priority leave the queue of the worker pool first
+TidyConfig.prototype.priority = 0;
+
+// Milliseconds a job may run before it gets rejected with ETIMEDOUT,
+// zero for no limit
+TidyConfig.prototype.timeout = 0;
+
+// Bytes the document may hold before a job fails with ENOMEM,
+// zero for no limit
+TidyConfig.prototype.memoryLimit = 0;
+
+// Whether tidyBuffer may be answered from the result cache,
+// see configureCache
+TidyConfig.prototype.cache = true;
+
+// Jobs of a config can't be aborted, so rather than ignoring a signal
+// they refuse to start
+function checkSignal(config) {
+  if (config.signal != null)
+    throw new TypeError("TidyConfig doesn't support signal, " +
+                        "use a TidyDoc for jobs which may get aborted");
+}
+
+// Tidy a document using one of the pooled documents of this config
+TidyConfig.prototype.tidyBuffer = function(buf, cb) {
+  if (cb) {
+    try {
+      checkSignal(this);
+    } catch (err) {
+      cb(err);
+      return;
+    }
+    this._tidy2(buf, res => cb(null, res), err => cb(err), this);
+  } else {
+    return new Promise((resolve, reject) => {
+      checkSignal(this);
+      this._tidy2(buf, resolve, reject, this);
+    });
+  }
+};
+
+// Same on the calling thread, returning the result
+TidyConfig.prototype.tidyBufferSync = function(buf) {
+  return this._tidySync2(buf, this);
+};
@@ -1,17 +1,42 @@
 "use strict";
 
 var lib = require("./lib");
+var start = require("./start");
 var TidyDoc = lib.TidyDoc;
 module.exports = TidyDoc;
 
 // Augment native code by some JavaScript-written convenience methods
 
+// Jobs with higher priority leave the queue of the worker pool first
+TidyDoc.prototype.priority = 0;
+
+// Milliseconds a job may run before it gets rejected with ETIMEDOUT,
+// zero for no limit
+TidyDoc.prototype.timeout = 0;
+
+// Bytes the document may hold before a job fails with ENOMEM,
+// zero for no limit
+TidyDoc.prototype.memoryLimit = 0;
+
+// Whether tidyBuffer may be answered from the result cache,
+// see configureCache. A cached result leaves the document unparsed.
+TidyDoc.prototype.cache = false;
+
+// Hash of an input file known to need no tidying, as reported by tidyFile
+// in inputHash or outputHash. A job tidying a file to a file
+// whose input has this hash resolves with skipped set,
+// without parsing the input or writing anything.
+TidyDoc.prototype.skipHash = null;
+
+// AbortSignal (or anything with the same interface)
+// which aborts the running job, rejecting it with ABORT_ERR
+TidyDoc.prototype.signal = null;
+
 TidyDoc.prototype._async1 = function(buf, b1, b2, b3, cb) {
-  if (cb)
-    this._async2(buf, b1, b2, b3, res => cb(null, res), err => cb(err));
-  else
-    return new Promise(
-      (resolve, reject) => this._async2(buf, b1, b2, b3, resolve, reject));
+  var res = start(this, (resolve, reject) =>
+    this._async2(buf, b1, b2, b3, resolve, reject, this));
+  if (cb) res.then(res => cb(null, res), err => cb(err));
+  else return res;
 }
 
 TidyDoc.prototype.parseBuffer = function(buf, cb) {
@@ -34,36 +59,208 @@ TidyDoc.prototype.tidyBuffer = function(buf, cb) {
   return this._async1(buf, true, true, true, cb);
 };
 
+// All phases of tidyBuffer in a single native call on the calling thread,
+// returning the result or throwing the error instead of a promise
+TidyDoc.prototype.tidyBufferSync = function(buf) {
+  return this._sync2(buf, true, true, true, this);
+};
+
+// Tidy the named input file, which gets read into native memory,
+// and write the output to the named output file from the worker thread,
+// or return it as a buffer if no output file is given
+TidyDoc.prototype.tidyFile = function(input, output, cb) {
+  if (typeof output !== "string") {
+    cb = output;
+    output = true;
+  }
+  return this._async1(String(input), true, true, output, cb);
+};
+
+// Parse, clean and repair and run diagnostics, but don't save the output
+TidyDoc.prototype.lint = function(buf, cb) {
+  return this._async1(buf, true, true, false, cb);
+};
+
+// Parse (unless buf is null), clean and repair,
+// then return matching attribute values instead of output
+TidyDoc.prototype.extract = function(buf, query, cb) {
+  var settings = Object.create(this, {extract: {value: query}});
+  var res = start(this, (resolve, reject) =>
+    this._async2(buf, buf !== null, false, false, resolve, reject, settings));
+  if (cb) res.then(res => cb(null, res), err => cb(err));
+  else return res;
+};
+
+// Error for a stream which got closed before it was done
+function prematureClose() {
+  var err = new Error("Premature close");
+  err.code = "ERR_STREAM_PREMATURE_CLOSE";
+  return err;
+}
+
+// Feed a readable stream into a native input stream,
+// pausing it while the parser has enough data queued up.
+// The input ends in any case, so that the parser never waits
+// for a readable which got destroyed.
+function feed(readable, input) {
+  var ended = false;
+  function finish(err) {
+    if (ended) return;
+    ended = true;
+    if (err) input.error = err;
+    input.end();
+  }
+  function onData(chunk) {
+    if (!Buffer.isBuffer(chunk))
+      chunk = Buffer(String(chunk));
+    if (!input.push(chunk))
+      readable.pause();
+  }
+  function onEnd() {
+    finish(null);
+  }
+  function onError(err) {
+    finish(err);
+  }
+  function onClose() {
+    finish(prematureClose());
+  }
+  input.ondrain = () => readable.resume();
+  readable.on("data", onData);
+  readable.once("end", onEnd);
+  readable.once("error", onError);
+  readable.once("close", onClose);
+  return () => {
+    readable.removeListener("data", onData);
+    readable.removeListener("end", onEnd);
+    readable.removeListener("error", onError);
+    readable.removeListener("close", onClose);
+    input.ondrain = null;
+  };
+}
+
+TidyDoc.prototype.parseStream = function(readable, cb) {
+  var input = new lib.TidyInputStream();
+  var detach = null;
+  var res = start(this, (resolve, reject) => {
+    this._async2(input, false, false, false, resolve, reject, this);
+    detach = feed(readable, input); // only once the job got accepted
+  }).then(res => {
+    detach();
+    if (input.error) throw input.error;
+    return res;
+  }, err => {
+    if (detach) detach();
+    throw err;
+  });
+  if (cb) res.then(res => cb(null, res), err => cb(err));
+  else return res;
+};
+
+// If the writable fails or gets closed before all output got written,
+// the job gets aborted, so that it doesn't wait for the writable
+// to drain, and rejected with the error of the writable.
+TidyDoc.prototype.saveStream = function(writable, cb) {
+  var output = new lib.TidyOutputStream();
+  var failure = null;
+  output.ondata = buf => {
+    if (failure) return true; // dropped
+    if (writable.write(buf)) return true;
+    writable.once("drain", () => output.resume());
+    return false;
+  };
+  var fail;
+  var ended = new Promise((resolve, reject) => {
+    output.onend = resolve;
+    fail = reject;
+  });
+  ended.catch(() => {}); // unless the job succeeded, it reports its error
+  var onError = err => {
+    if (failure) return;
+    failure = err;
+    this.abort();
+    output.resume();
+    fail(err);
+  };
+  var onClose = () => onError(prematureClose());
+  writable.on("error", onError);
+  writable.once("close", onClose);
+  var detach = () => {
+    writable.removeListener("error", onError);
+    writable.removeListener("close", onClose);
+  };
+  var res = start(this, (resolve, reject) =>
+    this._async2(null, false, false, output, resolve, reject, this)
+  ).then(res => ended.then(() => res)).then(res => {
+    detach();
+    return res;
+  }, err => {
+    detach();
+    throw failure || err;
+  });
+  if (cb) res.then(res => cb(null, res), err => cb(err));
+  else return res;
+};
+
+TidyDoc.prototype.tidyBatch = function(bufs, cb) {
+  var res = start(this, (resolve, reject) =>
+    this._batch2(bufs, resolve, reject, this));
+  if (cb) res.then(res => cb(null, res), err => cb(err));
+  else return res;
+};
+
+TidyDoc.prototype.lintBatch = function(bufs, cb) {
+  var settings = Object.create(this, {lint: {value: true}});
+  var res = start(this, (resolve, reject) =>
+    this._batch2(bufs, resolve, reject, settings));
+  if (cb) res.then(res => cb(null, res), err => cb(err));
+  else return res;
+};
+
+TidyDoc.prototype.tidyFragments = function(bufs, cb) {
+  var res = start(this, (resolve, reject) =>
+    this._fragments2(bufs, resolve, reject, this));
+  if (cb) res.then(res => cb(null, res), err => cb(err));
+  else return res;
+};
+
+// Live view of the options of each document, built on first access
+// from the static option table, so it costs no native calls to list
+var optionViews = new WeakMap();
+
+function optionView(doc) {
+  var view = optionViews.get(doc);
+  if (view) return view;
+  var props = {};
+  lib.optionTable.forEach(function(opt) {
+    props[opt.key] = {
+      configurable: true,
+      enumerable: true,
+      get: function() {
+        return doc.optGet(opt.id);
+      },
+      set: function(val) {
+        return doc.optSet(opt.id, val);
+      }
+    };
+  });
+  view = Object.defineProperties({}, props);
+  optionViews.set(doc, view);
+  return view;
+}
+
 Object.defineProperties(TidyDoc.prototype, {
 
   options: {
     configurable: true,
     enumerable: true,
     get: function() {
-      var doc = this;
-      var props = {};
-      this.getOptionList().forEach(function(opt) {
-        var prop = {
-          configurable: true,
-          enumerable: true,
-          get: function() {
-            return doc.optGet(opt);
-          },
-          set: function(val) {
-            return doc.optSet(opt, val);
-          }
-        };
-        var name = opt.toString();
-        //props[name] = prop;
-        props[name.replace(/-/g, '_')] = prop;
-      });
-      var obj = {};
-      Object.defineProperties(obj, props);
-      return obj;
+      return optionView(this);
     },
     set: function(opts) {
-      for (var key in opts)
-        this.optSet(key, opts[key]);
+      if (opts instanceof lib.TidyConfig)
+        return this.applyConfig(opts);
+      if (opts) this.setOptions(opts);
     },
   },
 
@@ -0,0 +1,69 @@
+"use strict";
+
+const stream = require("stream");
+
+var lib = require("./lib");
+var start = require("./start");
+
+// A transform stream tidying its whole input as one document.
+// Parsing starts while input is still arriving,
+// and output is pushed in chunks while it is being generated.
+class TidyStream extends stream.Transform {
+
+  constructor(doc) {
+    super();
+    this.errlog = null;
+    this._doc = doc;
+    this._running = true; // whether the job still holds the document
+    this._input = new lib.TidyInputStream();
+    this._output = new lib.TidyOutputStream();
+    this._pending = null; // callback of a write waiting for the parser
+    this._input.ondrain = () => {
+      var cb = this._pending;
+      this._pending = null;
+      if (cb) cb();
+    };
+    this._output.ondata = buf => this.push(buf);
+    var ended = new Promise(resolve => this._output.onend = resolve);
+    var job = start(doc, (resolve, reject) =>
+      doc._async2(this._input, true, true, this._output, resolve, reject, doc));
+    job.then(() => this._running = false, () => this._running = false);
+    this._done = job.then(res => ended.then(() => {
+      this.errlog = res.errlog;
+    }));
+    this._done.catch(err => {
+      if (!this.destroyed) this.emit("error", err);
+    });
+  }
+
+  _transform(chunk, encoding, cb) {
+    if (!Buffer.isBuffer(chunk))
+      chunk = Buffer(chunk, encoding);
+    if (this._input.push(chunk)) cb();
+    else this._pending = cb;
+  }
+
+  _flush(cb) {
+    this._input.end();
+    this._done.then(() => cb(), () => {}); // errors are emitted already
+  }
+
+  _read(size) {
+    this._output.resume();
+    super._read(size);
+  }
+
+  // Torn down before the job is done, e.g. by pipeline after an error
+  // further down: the job must not keep waiting for input
+  // or for the output to be read.
+  _destroy(err, cb) {
+    if (this._running)
+      this._doc.abort();
+    this._input.end();
+    this._output.resume();
+    cb(err);
+  }
+
+}
+
+module.exports = TidyStream;
@@ -0,0 +1,127 @@
+#include "node-libtidy.hh"
+
+namespace node_libtidy {
+
+  Batch::Batch(Doc* origin, v8::Local<v8::Object> holder,
+               v8::Local<v8::Array> inputs,
+               const JobSettings& settings, bool lint,
+               v8::Local<v8::Function> resolve,
+               v8::Local<v8::Function> reject)
+    : origin(origin), proto(origin->isArena()), settings(settings),
+      lint(lint), count(inputs->Length()), next(0), running(0),
+      filling(false), holder(holder), results(Nan::New<v8::Array>(count)),
+      resolve(resolve), reject(reject)
+  {
+    tidyOptCopyConfig(proto.doc, origin->doc);
+    proto.messages.configure(origin->messages);
+    // Changes to the array must not affect the batch
+    v8::Local<v8::Array> copy = Nan::New<v8::Array>(count);
+    for (uint32_t i = 0; i < count; ++i)
+      Nan::Set(copy, i, Nan::Get(inputs, i).ToLocalChecked());
+    this->inputs.Reset(copy);
+  }
+
+  Batch::~Batch() {
+    holder.Reset();
+    inputs.Reset();
+    results.Reset();
+    error.Reset();
+  }
+
+  // Twice the number of threads, so that the threads don't run dry
+  // while the main thread gets around to queueing the next inputs.
+  // Cache hits settle right away and don't count.
+  void Batch::Fill() {
+    Nan::HandleScope scope;
+    filling = true;
+    while (error.IsEmpty() && next < count &&
+           running < 2 * Pool::Threads()) {
+      uint32_t i = next++;
+      v8::Local<v8::Value> buf = Nan::Get(Nan::New(inputs), i)
+        .ToLocalChecked();
+      Doc* item = new Doc(proto.isArena());
+      tidyOptCopyConfig(item->doc, proto.doc);
+      item->messages.configure(proto.messages);
+      item->ResetErrorBuffer();
+      BatchWorker* w = new BatchWorker(this, i, item);
+      w->setOrigin(origin);
+      w->setLimits(settings);
+      w->SaveToPersistent(1u, buf);
+      w->setInput(node::Buffer::Data(buf), node::Buffer::Length(buf));
+      w->shouldCleanAndRepair = true;
+      w->shouldRunDiagnostics = true;
+      w->shouldSaveToBuffer = !lint;
+      ++running;
+      if (w->fromCache(settings)) {
+        delete w;
+        continue;
+      }
+      if (!Pool::Queue(w, settings.priority)) {
+        delete w;
+        Reject(Nan::Error("Tidy job queue is full"));
+      }
+    }
+    filling = false;
+    if (!running)
+      Settle();
+  }
+
+  void Batch::Resolve(uint32_t index, v8::Local<v8::Value> res) {
+    Nan::Set(Nan::New(results), index, res);
+    --running;
+    if (!filling)
+      Fill();
+  }
+
+  // Only the first error gets reported,
+  // but only after the other documents already running are done as well.
+  void Batch::Reject(v8::Local<v8::Value> err) {
+    if (error.IsEmpty())
+      error.Reset(err);
+    --running;
+    if (!filling)
+      Fill();
+  }
+
+  void Batch::Settle() {
+    Nan::HandleScope scope;
+    v8::Local<v8::Value> args[1];
+    if (error.IsEmpty()) {
+      args[0] = Nan::New(results);
+      resolve(1, args);
+    } else {
+      args[0] = Nan::New(error);
+      reject(1, args);
+    }
+    delete this;
+  }
+
+  BatchWorker::BatchWorker(Batch* batch, uint32_t index, Doc* doc)
+    : TidyWorker(doc), batch(batch), index(index)
+  {
+  }
+
+  BatchWorker::~BatchWorker() {
+    delete doc;
+  }
+
+  void BatchWorker::Resolve(v8::Local<v8::Value> res) {
+    batch->Resolve(index, res);
+  }
+
+  void BatchWorker::Reject(v8::Local<v8::Value> err) {
+    batch->Reject(err);
+  }
+
+  FragmentWorker::FragmentWorker(Doc* doc,
+                                 v8::Local<v8::Function> resolve,
+                                 v8::Local<v8::Function> reject)
+    : TidyWorker(doc, resolve, reject)
+  {
+  }
+
+  FragmentWorker::~FragmentWorker() {
+    delete doc;
+  }
+
+}
@@ -0,0 +1,73 @@
+namespace node_libtidy {
+
+  // Tidies several documents in parallel and collects their results.
+  // Lives on the main V8 thread and deletes itself once every document
+  // it started has been settled.
+  // Documents only get created as they are queued, a few more at a time
+  // than the pool has threads, so that a large batch neither holds
+  // all of its documents at once nor floods the queue.
+  // Once a document failed, the remaining inputs don't get started.
+  class Batch {
+  public:
+    // The configuration of the origin gets copied right away,
+    // while the origin is kept alive for aborting the batch.
+    Batch(Doc* origin, v8::Local<v8::Object> holder,
+          v8::Local<v8::Array> inputs,
+          const JobSettings& settings, bool lint,
+          v8::Local<v8::Function> resolve,
+          v8::Local<v8::Function> reject);
+    ~Batch();
+
+    // Queues inputs until enough are running.
+    // Might settle the batch, deleting it.
+    void Fill();
+
+    void Resolve(uint32_t index, v8::Local<v8::Value> res);
+    void Reject(v8::Local<v8::Value> err);
+
+  private:
+    void Settle();
+
+    Doc* origin;
+    Doc proto; // holds the copied configuration
+    JobSettings settings;
+    bool lint;
+    uint32_t count;
+    uint32_t next; // index of the next input to start
+    uint32_t running;
+    bool filling;
+    Nan::Persistent<v8::Object> holder;
+    Nan::Persistent<v8::Array> inputs;
+    Nan::Persistent<v8::Array> results;
+    Nan::Persistent<v8::Value> error;
+    Nan::Callback resolve;
+    Nan::Callback reject;
+  };
+
+  // Tidies one document of a batch.
+  // The worker takes ownership of the (unwrapped) document.
+  class BatchWorker : public TidyWorker {
+  public:
+    BatchWorker(Batch* batch, uint32_t index, Doc* doc);
+    ~BatchWorker();
+
+  protected:
+    void Resolve(v8::Local<v8::Value> res);
+    void Reject(v8::Local<v8::Value> err);
+
+  private:
+    Batch* batch;
+    uint32_t index;
+  };
+
+  // Tidies the fragments of a single batch, see Fragments.
+  // The worker takes ownership of the (unwrapped) document.
+  class FragmentWorker : public TidyWorker {
+  public:
+    FragmentWorker(Doc* doc,
+                   v8::Local<v8::Function> resolve,
+                   v8::Local<v8::Function> reject);
+    ~FragmentWorker();
+  };
+
+}
@@ -7,6 +7,12 @@ namespace node_libtidy {
 
     Buf() { tidyBufInitWithAllocator(&buf, &allocator); }
 
+    // The allocator must take its blocks from the global one,
+    // which frees them once they got handed over to a Node Buffer
+    explicit Buf(TidyAllocator* alloc) {
+      tidyBufInitWithAllocator(&buf, alloc);
+    }
+
     ~Buf() {
       tidyBufFree(&buf);
     }
@@ -27,14 +33,36 @@ namespace node_libtidy {
       return Nan::New<v8::String>(data(), buf.size);
     }
 
-    v8::MaybeLocal<v8::Object> buffer() const {
-      return Nan::CopyBuffer(data(), buf.size);
+    // Hands the storage over to a Node Buffer without copying it.
+    // The Buf is empty afterwards; the memory stays accounted for
+    // until the Buffer gets garbage collected.
+    v8::MaybeLocal<v8::Object> buffer() {
+      if (buf.size == 0)
+        return Nan::NewBuffer(0);
+      // The buffer grows by doubling, so trim excess capacity
+      if (buf.allocated - buf.size > buf.size / 4) {
+        void* bp = buf.allocator->vtbl->realloc(buf.allocator, buf.bp, buf.size);
+        if (bp) {
+          buf.bp = static_cast<byte*>(bp);
+          buf.allocated = buf.size;
+        }
+      }
+      v8::MaybeLocal<v8::Object> res =
+        Nan::NewBuffer(data(), buf.size, freeData, &allocator);
+      if (!res.IsEmpty())
+        tidyBufInitWithAllocator(&buf, buf.allocator);
+      return res;
     }
 
   private:
 
     TidyBuffer buf;
 
+    static void freeData(char* data, void* hint) {
+      TidyAllocator* alloc = static_cast<TidyAllocator*>(hint);
+      alloc->vtbl->free(alloc, data);
+    }
+
     char* data() const {
       return b2c(buf.bp);
     }
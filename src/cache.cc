@@ -0,0 +1,444 @@
+#include "node-libtidy.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <sstream>
+
+namespace node_libtidy {
+
+  namespace Cache {
+
+    namespace {
+
+      struct Entry {
+        Key key;
+        std::string input;
+        std::string output;
+        std::string errlog;
+
+        size_t cost() const {
+          return sizeof(Entry) + input.length() + output.length() +
+            errlog.length();
+        }
+      };
+
+      // Most recently used first
+      typedef std::list<Entry> List;
+
+      // Shared by all threads running JavaScript.
+      // The mutex protects all of the following.
+      uv_once_t once = UV_ONCE_INIT;
+      uv_mutex_t mutex;
+      List entries;
+      std::map<Key, List::iterator> index;
+      size_t maxBytes = 0; // zero disables the cache
+      size_t bytes = 0;
+      double hits = 0;
+      double misses = 0;
+      std::string file;
+
+      const char magic[] = "node-libtidy result cache 2\n";
+
+      // Not a cryptographic hash, just a fast one mixing 8 bytes at a time,
+      // along the lines of the body of MurmurHash3.
+      const uint64_t k1 = 0x87c37b91114253d5ULL;
+      const uint64_t k2 = 0x4cf5ad432745937fULL;
+
+      inline uint64_t Rotl(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+      }
+
+      inline uint64_t Mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+      }
+
+      inline uint64_t Word(uint64_t h, uint64_t w) {
+        w *= k1;
+        w = Rotl(w, 31);
+        w *= k2;
+        h ^= w;
+        return Rotl(h, 27) * 5 + 0x52dce729;
+      }
+
+      uint64_t Hash(const char* data, size_t length, uint64_t seed) {
+        uint64_t h = seed;
+        size_t i = 0;
+        for (; i + 8 <= length; i += 8) {
+          uint64_t w;
+          std::memcpy(&w, data + i, 8);
+          h = Word(h, w);
+        }
+        uint64_t w = 0;
+        if (i < length)
+          std::memcpy(&w, data + i, length - i);
+        return Mix(Word(h, w) ^ length);
+      }
+
+      void Remove(List::iterator i) {
+        bytes -= i->cost();
+        index.erase(i->key);
+        entries.erase(i);
+      }
+
+      void Clear() {
+        entries.clear();
+        index.clear();
+        bytes = 0;
+      }
+
+      void Evict() {
+        while (bytes > maxBytes && !entries.empty())
+          Remove(--entries.end());
+      }
+
+      // Replaces an entry for a colliding input,
+      // which then misses until it gets stored again
+      void Insert(const Key& key, std::string& input,
+                  std::string& output, std::string& errlog) {
+        std::map<Key, List::iterator>::iterator i = index.find(key);
+        if (i != index.end())
+          Remove(i->second);
+        entries.push_front(Entry());
+        Entry& entry = entries.front();
+        entry.key = key;
+        entry.input.swap(input);
+        entry.output.swap(output);
+        entry.errlog.swap(errlog);
+        index[key] = entries.begin();
+        bytes += entry.cost();
+        Evict();
+      }
+
+      // The file holds the magic line, the libtidy version
+      // and then the entries, least recently used first,
+      // all in native byte order.
+      // Numbers are 64 bits, strings are preceded by their length.
+
+      bool WriteNumber(std::FILE* f, uint64_t num) {
+        return std::fwrite(&num, sizeof(num), 1, f) == 1;
+      }
+
+      bool WriteString(std::FILE* f, const std::string& str) {
+        return WriteNumber(f, str.length()) &&
+          std::fwrite(str.data(), 1, str.length(), f) == str.length();
+      }
+
+      bool ReadNumber(std::FILE* f, uint64_t& num) {
+        return std::fread(&num, sizeof(num), 1, f) == 1;
+      }
+
+      bool ReadString(std::FILE* f, std::string& str) {
+        uint64_t length;
+        if (!ReadNumber(f, length) || length > maxBytes) return false;
+        str.resize(length);
+        return length == 0 || std::fread(&str[0], 1, length, f) == length;
+      }
+
+      // A missing, outdated or damaged file simply leaves the cache cold.
+      // Entries whose input doesn't match their key get skipped.
+      void Load() {
+        std::FILE* f = std::fopen(file.c_str(), "rb");
+        if (!f) return;
+        char buf[sizeof(magic) - 1];
+        std::string version;
+        if (std::fread(buf, 1, sizeof(buf), f) == sizeof(buf) &&
+            std::memcmp(buf, magic, sizeof(buf)) == 0 &&
+            ReadString(f, version) && version == tidyLibraryVersion()) {
+          Entry entry;
+          while (ReadNumber(f, entry.key.input) &&
+                 ReadNumber(f, entry.key.length) &&
+                 ReadNumber(f, entry.key.options) &&
+                 ReadString(f, entry.input) &&
+                 ReadString(f, entry.output) &&
+                 ReadString(f, entry.errlog)) {
+            if (entry.input.length() == entry.key.length &&
+                Hash(entry.input.data(), entry.input.length(), 0) ==
+                entry.key.input)
+              Insert(entry.key, entry.input, entry.output, entry.errlog);
+          }
+        }
+        std::fclose(f);
+      }
+
+      // Writes a temporary file first, so that a crash while saving
+      // doesn't destroy the previous state.
+      bool Save() {
+        std::string tmp = file + ".tmp";
+        std::FILE* f = std::fopen(tmp.c_str(), "wb");
+        if (!f) return false;
+        bool ok = std::fwrite(magic, 1, sizeof(magic) - 1, f) ==
+          sizeof(magic) - 1 && WriteString(f, tidyLibraryVersion());
+        for (List::reverse_iterator i = entries.rbegin(), e = entries.rend();
+             ok && i != e; ++i) {
+          ok = WriteNumber(f, i->key.input) &&
+            WriteNumber(f, i->key.length) &&
+            WriteNumber(f, i->key.options) &&
+            WriteString(f, i->input) &&
+            WriteString(f, i->output) &&
+            WriteString(f, i->errlog);
+        }
+        int err = ok ? 0 : errno;
+        if (std::fclose(f) && ok) {
+          ok = false;
+          err = errno;
+        }
+        if (ok && std::rename(tmp.c_str(), file.c_str())) {
+          ok = false;
+          err = errno;
+        }
+        if (!ok) {
+          std::remove(tmp.c_str());
+          errno = err;
+        }
+        return ok;
+      }
+
+      void Setup() {
+        uv_mutex_init(&mutex);
+      }
+
+    }
+
+    NAN_MODULE_INIT(Init) {
+      uv_once(&once, Setup);
+      Nan::SetMethod(target, "configureCache", configure);
+      Nan::SetMethod(target, "cacheStats", stats);
+      Nan::SetMethod(target, "flushCache", flush);
+    }
+
+    bool IsEnabled() {
+      uv_mutex_lock(&mutex);
+      bool res = maxBytes != 0;
+      uv_mutex_unlock(&mutex);
+      return res;
+    }
+
+    void Hasher::update(const char* data, size_t n) {
+      length += n;
+      if (pending) {
+        size_t k = std::min(n, size_t(8 - pending));
+        std::memcpy(tail + pending, data, k);
+        pending += unsigned(k);
+        data += k;
+        n -= k;
+        if (pending < 8) return;
+        uint64_t w;
+        std::memcpy(&w, tail, 8);
+        h = Word(h, w);
+        pending = 0;
+      }
+      for (; n >= 8; data += 8, n -= 8) {
+        uint64_t w;
+        std::memcpy(&w, data, 8);
+        h = Word(h, w);
+      }
+      std::memcpy(tail, data, n);
+      pending = unsigned(n);
+    }
+
+    uint64_t Hasher::digest() const {
+      uint64_t w = 0;
+      std::memcpy(&w, tail, pending);
+      return Mix(Word(h, w) ^ length);
+    }
+
+    Key MakeKey(TidyDoc doc, const char* data, size_t length) {
+      Key key;
+      key.input = Hash(data, length, 0);
+      key.length = length;
+      key.options = HashOptions(doc);
+      return key;
+    }
+
+    uint64_t HashOptions(TidyDoc doc) {
+      uint64_t h = 0;
+      TidyIterator iter = tidyGetOptionList(doc);
+      while (iter) {
+        TidyOption opt = tidyGetNextOption(doc, &iter);
+        TidyOptionId id = tidyOptGetId(opt);
+        if (tidyOptGetType(opt) == TidyString) {
+          ctmbstr str = tidyOptGetValue(doc, id);
+          if (str)
+            h = Hash(str, std::strlen(str), Word(h, id));
+          else // distinguish null from the empty string
+            h = Word(Word(h, id), ~0ULL);
+        } else {
+          h = Word(Word(h, id), tidyOptGetInt(doc, id));
+        }
+      }
+      return Mix(h);
+    }
+
+    v8::Local<v8::String> HashString(uint64_t h) {
+      char str[17];
+      for (int i = 15; i >= 0; --i, h >>= 4)
+        str[i] = "0123456789abcdef"[h & 15];
+      str[16] = '\0';
+      return Nan::New(str).ToLocalChecked();
+    }
+
+    bool ParseHash(v8::Local<v8::Value> str, uint64_t& h) {
+      if (!str->IsString()) return false;
+      Nan::Utf8String utf8(str);
+      if (utf8.length() != 16) return false;
+      uint64_t res = 0;
+      for (int i = 0; i < 16; ++i) {
+        char c = (*utf8)[i];
+        res <<= 4;
+        if (c >= '0' && c <= '9') res |= c - '0';
+        else if (c >= 'a' && c <= 'f') res |= c - 'a' + 10;
+        else return false;
+      }
+      h = res;
+      return true;
+    }
+
+    v8::Local<v8::Object> Lookup(const Key& key,
+                                 const char* data, size_t length) {
+      Nan::EscapableHandleScope scope;
+      uv_mutex_lock(&mutex);
+      std::map<Key, List::iterator>::iterator i = index.find(key);
+      if (i == index.end() ||
+          i->second->input.compare(0, std::string::npos, data, length)) {
+        ++misses;
+        uv_mutex_unlock(&mutex);
+        return scope.Escape(v8::Local<v8::Object>());
+      }
+      ++hits;
+      entries.splice(entries.begin(), entries, i->second);
+      // Copy while locked, since another thread might evict the entry
+      std::string output = entries.front().output;
+      std::string errlog = entries.front().errlog;
+      uv_mutex_unlock(&mutex);
+      v8::Local<v8::Object> res = Nan::New<v8::Object>();
+      Nan::Set(res, Nan::New("output").ToLocalChecked(),
+               Nan::CopyBuffer(output.data(),
+                               output.length()).ToLocalChecked());
+      Nan::Set(res, Nan::New("errlog").ToLocalChecked(),
+               NewString(errlog));
+      Nan::Set(res, Nan::New("metrics").ToLocalChecked(),
+               Nan::New<v8::Object>());
+      Nan::Set(res, Nan::New("cached").ToLocalChecked(), Nan::True());
+      return scope.Escape(res);
+    }
+
+    // The buffer holding the input might have been modified
+    // while the job was running
+    void Store(const Key& key, const char* data, size_t length,
+               v8::Local<v8::Value> output, v8::Local<v8::Value> errlog) {
+      if (!node::Buffer::HasInstance(output)) return;
+      if (length != key.length || Hash(data, length, 0) != key.input) return;
+      std::string in(data, length);
+      std::string out(node::Buffer::Data(output),
+                      node::Buffer::Length(output));
+      Nan::Utf8String log(errlog);
+      std::string err(*log, log.length());
+      uv_mutex_lock(&mutex);
+      if (maxBytes)
+        Insert(key, in, out, err);
+      uv_mutex_unlock(&mutex);
+    }
+
+    // arguments:
+    // 0 - object with optional properties
+    //     maxBytes - budget for the cached results, zero to disable
+    //     file - name of a file to load the cache from and flush it to,
+    //            or null for none
+    //     clear - if true, drop all entries
+    NAN_METHOD(configure) {
+      if (!info[0]->IsObject()) {
+        Nan::ThrowTypeError("Argument to configureCache must be an object");
+        return;
+      }
+      v8::Local<v8::Object> opts = info[0].As<v8::Object>();
+      v8::Local<v8::Value> val =
+        Nan::Get(opts, Nan::New("maxBytes").ToLocalChecked()).ToLocalChecked();
+      bool setMax = !val->IsUndefined();
+      size_t max = 0;
+      if (setMax) {
+        double num = Nan::To<double>(val).FromJust();
+        if (!(num >= 0 && num < 9007199254740992.0)) {
+          Nan::ThrowRangeError("Cache setting 'maxBytes' "
+                               "must be a non-negative number");
+          return;
+        }
+        max = num < SIZE_MAX ? size_t(num) : SIZE_MAX;
+      }
+      val = Nan::Get(opts, Nan::New("file").ToLocalChecked()).ToLocalChecked();
+      bool setFile = !val->IsUndefined();
+      std::string name;
+      if (val->IsString()) {
+        Nan::Utf8String str(val);
+        name.assign(*str, str.length());
+      } else if (setFile && !val->IsNull()) {
+        Nan::ThrowTypeError("Cache setting 'file' must be a string or null");
+        return;
+      }
+      val = Nan::Get(opts, Nan::New("clear").ToLocalChecked()).ToLocalChecked();
+      bool clear = Nan::To<bool>(val).FromJust();
+      uv_mutex_lock(&mutex);
+      if (setMax)
+        maxBytes = max;
+      if (clear || !maxBytes)
+        Clear();
+      Evict();
+      if (setFile && name != file) {
+        file = name;
+        if (maxBytes && !file.empty())
+          Load();
+      }
+      uv_mutex_unlock(&mutex);
+    }
+
+    NAN_METHOD(stats) {
+      uv_mutex_lock(&mutex);
+      double max = maxBytes, used = bytes, count = index.size(),
+        found = hits, missed = misses;
+      std::string name = file;
+      uv_mutex_unlock(&mutex);
+      v8::Local<v8::Object> res = Nan::New<v8::Object>();
+      Nan::Set(res, Nan::New("maxBytes").ToLocalChecked(), Nan::New(max));
+      Nan::Set(res, Nan::New("bytes").ToLocalChecked(), Nan::New(used));
+      Nan::Set(res, Nan::New("entries").ToLocalChecked(), Nan::New(count));
+      Nan::Set(res, Nan::New("hits").ToLocalChecked(), Nan::New(found));
+      Nan::Set(res, Nan::New("misses").ToLocalChecked(), Nan::New(missed));
+      if (name.empty())
+        Nan::Set(res, Nan::New("file").ToLocalChecked(), Nan::Null());
+      else
+        Nan::Set(res, Nan::New("file").ToLocalChecked(), NewString(name));
+      info.GetReturnValue().Set(res);
+    }
+
+    // Writes all entries to the configured file, if there is one.
+    // Returns whether a file was written.
+    NAN_METHOD(flush) {
+      uv_mutex_lock(&mutex);
+      std::string name = file;
+      bool ok = name.empty() || Save();
+      int err = errno;
+      uv_mutex_unlock(&mutex);
+      if (name.empty()) {
+        info.GetReturnValue().Set(Nan::False());
+        return;
+      }
+      if (!ok) {
+        std::ostringstream buf;
+        buf << "Cannot write cache file '" << name << "': "
+            << std::strerror(err);
+        Nan::ThrowError(NewString(buf.str()));
+        return;
+      }
+      info.GetReturnValue().Set(Nan::True());
+    }
+
+  }
+
+}
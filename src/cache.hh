@@ -0,0 +1,74 @@
+namespace node_libtidy {
+
+  // Results of tidyBuffer jobs kept by the hash of their input
+  // and of the options they ran with, so that byte-identical inputs
+  // get answered without running libtidy at all.
+  // The hash only locates an entry: the entry keeps the input as well,
+  // and answers only a job whose input is the same byte for byte,
+  // so that inputs crafted to collide can't replace the result
+  // of some other input.
+  // The cache is disabled until configured with a byte budget.
+  // It is shared by all threads, since jobs finishing on the threads
+  // of the pool store their results, so every access takes its mutex.
+  namespace Cache {
+
+    struct Key {
+      uint64_t input;
+      uint64_t length;
+      uint64_t options;
+
+      bool operator<(const Key& other) const {
+        if (input != other.input) return input < other.input;
+        if (length != other.length) return length < other.length;
+        return options < other.options;
+      }
+    };
+
+    NAN_MODULE_INIT(Init);
+
+    // The hash of the keys, for data which arrives in pieces.
+    // Gives the same result as hashing all of it at once.
+    class Hasher {
+    public:
+      Hasher() : h(0), length(0), pending(0) { }
+      void update(const char* data, size_t n);
+      uint64_t digest() const;
+
+    private:
+      uint64_t h;
+      uint64_t length;
+      char tail[8];
+      unsigned pending; // bytes in tail
+    };
+
+    bool IsEnabled();
+
+    // Hashes the input together with all options of the document
+    Key MakeKey(TidyDoc doc, const char* data, size_t length);
+
+    // Hashes all options of the document
+    uint64_t HashOptions(TidyDoc doc);
+
+    // Hexadecimal form of a hash, as JavaScript gets to see them
+    v8::Local<v8::String> HashString(uint64_t h);
+
+    // Reads such a hexadecimal string, returns false for anything else
+    bool ParseHash(v8::Local<v8::Value> str, uint64_t& h);
+
+    // Returns an {output, errlog, metrics, cached} result
+    // or an empty handle if there is no entry for the key and input
+    v8::Local<v8::Object> Lookup(const Key& key,
+                                 const char* data, size_t length);
+
+    // Remembers the output buffer and error log of a finished job,
+    // unless its input no longer matches the key
+    void Store(const Key& key, const char* data, size_t length,
+               v8::Local<v8::Value> output, v8::Local<v8::Value> errlog);
+
+    NAN_METHOD(configure);
+    NAN_METHOD(stats);
+    NAN_METHOD(flush);
+
+  }
+
+}
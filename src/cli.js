@@ -2,8 +2,16 @@
 
 "use strict";
 
+const fs = require("fs");
+const path = require("path");
 const libtidy = require("../");
 
+let lintOnly = false;
+let outDir = null;
+let jobs = 0; // default to the size of the worker pool
+let manifest = null;
+let watch = false;
+
 function OptionHandler(doc, args) {
   this.doc = doc;
   doc.options = {
@@ -111,29 +119,140 @@ OptionHandler.prototype = {
     process.exit(0);
   },
   "-access": "accessibility-check=",
+  "-lint": function() {
+    lintOnly = true;
+  },
+  "-outdir": function(dir) {
+    outDir = dir;
+  },
+  "-manifest": function(file) {
+    manifest = file;
+  },
+  "-watch": function() {
+    watch = true;
+  },
+  "-j": "-jobs",
+  "-jobs": function(n) {
+    jobs = Number(n);
+    if (!(jobs > 0 && jobs === Math.floor(jobs))) {
+      console.error(`Invalid number of jobs: ${n}`);
+      process.exit(1);
+    }
+  },
 };
 
+// Tidy all files in place, or into the output directory,
+// reporting progress unless asked to be quiet.
+// With -manifest, files known to be tidy already get skipped,
+// and with -watch, files get tidied again whenever they change.
+// Exits with 2 if any of the files failed, unless watching.
+function tidyMany(files, opts, quiet) {
+  let output;
+  if (outDir !== null) {
+    try {
+      fs.mkdirSync(outDir);
+    } catch (err) {
+      if (err.code !== "EEXIST") throw err;
+    }
+    const seen = new Set();
+    for (let file of files) {
+      const name = path.basename(file);
+      if (seen.has(name)) {
+        console.error(`More than one input named ${name}`);
+        process.exit(1);
+      }
+      seen.add(name);
+    }
+    output = name => path.join(outDir, path.basename(name));
+  }
+  let done = 0, failed = 0, skipped = 0, errors = 0, warnings = 0;
+  const settings = {
+    output: output,
+    concurrency: jobs,
+    manifest: manifest,
+    messages: {levels: ["Warning", "Error", "BadDocument", "Fatal"]},
+    onFile: (err, res, index) => {
+      ++done;
+      const messages = (err || res).messages;
+      if (messages) {
+        for (let msg of libtidy.unpackMessages(messages)) {
+          if (msg.level === "Warning") ++warnings;
+          else ++errors;
+        }
+      }
+      const progress = watch ? "" : `[${done}/${files.length}] `;
+      if (err) {
+        ++failed;
+        console.error(`${progress}${err.message}`);
+      } else if (res.skipped) {
+        ++skipped;
+      } else if (!quiet) {
+        const note = res.unchanged ? " (unchanged)" : "";
+        console.error(`${progress}${files[index]}${note}`);
+      }
+    },
+  };
+  if (watch) {
+    // Keep going until interrupted, reporting each file as it gets tidied
+    const watcher = libtidy.watchFiles(files, opts, settings);
+    watcher.on("error", err => console.error(String(err)));
+    return new Promise(() => {});
+  }
+  return libtidy.tidyFileQueue(files, opts, settings).then(() => {
+    if (!quiet || failed)
+      console.error(`${done - failed - skipped} of ${files.length} ` +
+                    `files tidied, ${skipped} skipped, ${failed} failed; ` +
+                    `${errors} errors, ${warnings} warnings`);
+    process.exit(failed ? 2 : 0);
+  });
+}
+
+// Report the diagnostics of all files without producing any output.
+// Exits with 2 if there were errors, 1 if there were only warnings.
+function lint(positional, opts) {
+  let promise;
+  if (positional.length === 0)
+    promise = libtidy.readStdin().then(input => [input]);
+  else
+    promise = Promise.all(positional.map(libtidy.readFile));
+  return promise.then(inputs =>
+    libtidy.lint(inputs.map(input => input.buf), opts).then(results => {
+      let status = 0;
+      results.forEach((res, i) => {
+        for (let msg of libtidy.unpackMessages(res.messages)) {
+          console.log(`${inputs[i].name}:${msg.line}:${msg.column}: ` +
+                      `${msg.level}: ${msg.code}`);
+          if (msg.level === "Warning" || msg.level === "Access")
+            status = Math.max(status, 1);
+          else if (msg.level !== "Info")
+            status = 2;
+        }
+      });
+      process.exit(status);
+    }));
+}
+
 function main(args) {
   const doc = new libtidy.TidyDoc();
   const positional = new OptionHandler(doc, args);
-  const opts = {};
-  for (let opt of doc.getOptionList()) {
-    let value = doc.optGet(opt);
-    if (!opt.readOnly && value != opt.default)
-      opts[opt] = value;
-  }
+  const opts = doc.getOptions(true);
   let promise = null;
-  if (doc.options.write_back) {
-    promise = libtidy.tidyFilesInPlace(positional, opts);
+  if (lintOnly) {
+    promise = lint(positional, opts);
+  } else if (doc.options.write_back || outDir !== null) {
+    promise = tidyMany(positional, opts, doc.options.quiet);
   } else if (positional.length > 1) {
-    console.error("Cannot tidy more than one file unless -modify is specified");
+    console.error("Cannot tidy more than one file " +
+                  "unless -modify or -outdir is specified");
     process.exit(1);
+  } else if (positional.length === 1 && doc.options.output_file) {
+    promise = libtidy.tidyFileToFile(
+      positional[0], doc.options.output_file, opts);
   } else {
     if (positional.length === 0)
-      promise = libtidy.readStdin();
+      promise = libtidy.readStdin().then(libtidy.tidyUp(opts));
     else
-      promise = libtidy.readFile(positional[0]);
-    promise = promise.then(libtidy.tidyUp(opts));
+      promise = libtidy.tidyFile(positional[0], opts);
     if (doc.options.output_file)
       promise = promise.then(libtidy.writeFile(doc.options.output_file));
     else
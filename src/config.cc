@@ -0,0 +1,264 @@
+#include "node-libtidy.hh"
+
+namespace node_libtidy {
+
+  namespace {
+
+    // Tidies a document borrowed from the pool of a Config,
+    // and returns it there once done.
+    class PooledWorker : public TidyWorker {
+    public:
+      PooledWorker(Config* config, Doc* doc,
+                   v8::Local<v8::Function> resolve,
+                   v8::Local<v8::Function> reject)
+        : TidyWorker(doc, resolve, reject), config(config)
+      {
+        SaveToPersistent(0u, config->handle());
+        shouldDropTree = true;
+      }
+
+      ~PooledWorker() {
+        config->Release(doc);
+      }
+
+    private:
+      Config* config;
+    };
+
+  }
+
+  NAN_MODULE_INIT(Config::Init) {
+    v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
+    tpl->SetClassName(Nan::New("TidyConfig").ToLocalChecked());
+    tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+    Nan::SetPrototypeMethod(tpl, "optGet", optGet);
+    Nan::SetPrototypeMethod(tpl, "getOptions", getOptions);
+    Nan::SetPrototypeMethod(tpl, "_tidy2", tidy);
+    Nan::SetPrototypeMethod(tpl, "_tidySync2", tidySync);
+    v8::Local<v8::ObjectTemplate> itpl = tpl->InstanceTemplate();
+    Nan::SetAccessor(itpl, Nan::New("poolSize").ToLocalChecked(),
+                     getPoolSize, setPoolSize);
+    Nan::SetAccessor(itpl, Nan::New("idle").ToLocalChecked(), getIdle);
+
+    tpl = Instance::Keep(Instance::Current()->configTemplate, tpl);
+    Nan::Set(target, Nan::New("TidyConfig").ToLocalChecked(),
+             Nan::GetFunction(tpl).ToLocalChecked());
+  }
+
+  Config* Config::Unwrap(v8::Local<v8::Value> value) {
+    v8::Local<v8::FunctionTemplate> tpl =
+      Nan::New(Instance::Current()->configTemplate);
+    if (!tpl->HasInstance(value)) return NULL;
+    return Nan::ObjectWrap::Unwrap<Config>(value.As<v8::Object>());
+  }
+
+  Config::Config() : poolSize(8) {
+    doc = tidyCreateWithAllocator(&allocator);
+    tidySetErrorBuffer(doc, err);
+  }
+
+  Config::~Config() {
+    for (std::vector<Doc*>::iterator i = idle.begin(), e = idle.end();
+         i != e; ++i)
+      delete *i;
+    tidyRelease(doc);
+  }
+
+  void Config::ApplyTo(TidyDoc target) const {
+    tidyOptCopyConfig(target, doc);
+  }
+
+  // Creating a document sets up its tag and attribute tables,
+  // which is what the pool saves.
+  // Copying the options again is cheap, and makes sure
+  // no option changed by the previous document sticks.
+  Doc* Config::Acquire() {
+    Doc* res;
+    if (idle.empty()) {
+      res = new Doc();
+    } else {
+      res = idle.back();
+      idle.pop_back();
+    }
+    ApplyTo(res->doc);
+    res->ResetErrorBuffer();
+    return res;
+  }
+
+  void Config::Release(Doc* item) {
+    item->Unlock();
+    if (idle.size() >= poolSize) {
+      delete item;
+      return;
+    }
+    item->Recycle();
+    idle.push_back(item);
+  }
+
+  // arguments:
+  // 0 - optional dictionary of options, with keys in any of the formats
+  //     accepted by TidyDoc.optSet
+  NAN_METHOD(Config::New) {
+    if (!info.IsConstructCall()) {
+      const int argc = 1;
+      v8::Local<v8::Value> argv[argc] = {info[0]};
+      v8::Local<v8::Function> cons =
+        Nan::GetFunction(Nan::New(Instance::Current()->configTemplate))
+        .ToLocalChecked();
+      Nan::MaybeLocal<v8::Object> res = Nan::NewInstance(cons, argc, argv);
+      if (!res.IsEmpty())
+        info.GetReturnValue().Set(res.ToLocalChecked());
+      return;
+    }
+    Config* obj = new Config();
+    obj->Wrap(info.This());
+    if (info[0]->IsObject()) {
+      v8::Local<v8::Object> opts = info[0].As<v8::Object>();
+      v8::Local<v8::Array> keys = Nan::GetPropertyNames(opts).ToLocalChecked();
+      for (uint32_t i = 0, n = keys->Length(); i < n; ++i) {
+        v8::Local<v8::Value> key = Nan::Get(keys, i).ToLocalChecked();
+        TidyOption opt = Opt::Resolve(obj->doc, key);
+        if (!opt) return;
+        obj->err.reset();
+        if (!Opt::Set(obj->doc, opt, Nan::Get(opts, key).ToLocalChecked(),
+                      obj->err))
+          return;
+      }
+    } else if (!info[0]->IsUndefined()) {
+      Nan::ThrowTypeError("Argument to TidyConfig must be an object");
+      return;
+    }
+    info.GetReturnValue().Set(info.This());
+  }
+
+  // arguments:
+  // 0 - option as for TidyDoc.optGet
+  NAN_METHOD(Config::optGet) {
+    Config* self = Unwrap(info.Holder());
+    if (!self) {
+      Nan::ThrowTypeError("Not a valid TidyConfig object");
+      return;
+    }
+    TidyOption opt = Opt::Resolve(self->doc, info[0]);
+    if (!opt) return;
+    info.GetReturnValue().Set(Opt::Get(self->doc, opt));
+  }
+
+  // arguments:
+  // 0 - optional boolean as for TidyDoc.getOptions
+  NAN_METHOD(Config::getOptions) {
+    Config* self = Unwrap(info.Holder());
+    if (!self) {
+      Nan::ThrowTypeError("Not a valid TidyConfig object");
+      return;
+    }
+    bool changedOnly = Nan::To<bool>(info[0]).FromJust();
+    info.GetReturnValue().Set(Opt::GetAll(self->doc, changedOnly));
+  }
+
+  // arguments:
+  // 0 - input buffer
+  // 1 - resolve callback to invoke once we are done successfully
+  // 2 - reject callback to invoke if there was an error
+  // 3 - optional object holding job settings, as for TidyDoc._async2
+  NAN_METHOD(Config::tidy) {
+    Config* self = Unwrap(info.Holder());
+    if (!self) {
+      Nan::ThrowTypeError("Not a valid TidyConfig object");
+      return;
+    }
+    if (info.Length() != 3 && info.Length() != 4) {
+      Nan::ThrowTypeError("_tidy2 must be called with 3 or 4 arguments.");
+      return;
+    }
+    if (!node::Buffer::HasInstance(info[0])) {
+      Nan::ThrowTypeError("First argument to _tidy2 must be a buffer");
+      return;
+    }
+    if (!info[1]->IsFunction()) {
+      Nan::ThrowTypeError("Resolve argument to _tidy2 must be a function");
+      return;
+    }
+    if (!info[2]->IsFunction()) {
+      Nan::ThrowTypeError("Reject argument to _tidy2 must be a function");
+      return;
+    }
+    JobSettings settings(info[3]);
+    PooledWorker* w = new PooledWorker(self, self->Acquire(),
+                                       info[1].As<v8::Function>(),
+                                       info[2].As<v8::Function>());
+    w->setLimits(settings);
+    w->SaveToPersistent(1u, info[0]);
+    w->setInput(node::Buffer::Data(info[0]), node::Buffer::Length(info[0]));
+    w->shouldCleanAndRepair = true;
+    w->shouldRunDiagnostics = true;
+    w->shouldSaveToBuffer = true;
+    if (w->fromCache(settings)) {
+      delete w;
+      return;
+    }
+    if (!Pool::Queue(w, settings.priority)) {
+      delete w;
+      Nan::ThrowError("Tidy job queue is full");
+    }
+  }
+
+  // arguments:
+  // 0 - input buffer
+  // 1 - optional object holding job settings, as for TidyDoc._sync2
+  // Returns the result _tidy2 would resolve to.
+  NAN_METHOD(Config::tidySync) {
+    Config* self = Unwrap(info.Holder());
+    if (!self) {
+      Nan::ThrowTypeError("Not a valid TidyConfig object");
+      return;
+    }
+    if (!node::Buffer::HasInstance(info[0])) {
+      Nan::ThrowTypeError("First argument to _tidySync2 must be a buffer");
+      return;
+    }
+    JobSettings settings(info[1]);
+    Doc* doc = self->Acquire();
+    v8::Local<v8::Value> res;
+    {
+      TidyJob job(doc);
+      job.setLimits(settings);
+      job.setInput(node::Buffer::Data(info[0]),
+                   node::Buffer::Length(info[0]));
+      job.shouldCleanAndRepair = true;
+      job.shouldRunDiagnostics = true;
+      job.shouldSaveToBuffer = true;
+      job.shouldDropTree = true;
+      res = job.RunSync(settings);
+    }
+    self->Release(doc);
+    if (!res.IsEmpty())
+      info.GetReturnValue().Set(res);
+  }
+
+  NAN_GETTER(Config::getPoolSize) {
+    Config* self = Unwrap(info.Holder()); if (!self) return;
+    info.GetReturnValue().Set(Nan::New(double(self->poolSize)));
+  }
+
+  NAN_SETTER(Config::setPoolSize) {
+    Config* self = Unwrap(info.Holder()); if (!self) return;
+    double num = Nan::To<double>(value).FromJust();
+    if (!(num >= 0 && num <= 0xffff) || num != unsigned(num)) {
+      Nan::ThrowRangeError("poolSize must be a non-negative integer");
+      return;
+    }
+    self->poolSize = num;
+    while (self->idle.size() > self->poolSize) {
+      delete self->idle.back();
+      self->idle.pop_back();
+    }
+  }
+
+  NAN_GETTER(Config::getIdle) {
+    Config* self = Unwrap(info.Holder()); if (!self) return;
+    info.GetReturnValue().Set(Nan::New(double(self->idle.size())));
+  }
+
+}
@@ -0,0 +1,44 @@
+namespace node_libtidy {
+
+  // Options resolved and validated once, to be applied to many documents.
+  // The values live in a private document serving as a template,
+  // whose configuration is a vector of values indexed by option id.
+  // Applying them is a single tidyOptCopyConfig call,
+  // without any name lookups or value parsing.
+  class Config : public Nan::ObjectWrap {
+  public:
+    static NAN_MODULE_INIT(Init);
+
+    // Returns NULL if the value is not a Config
+    static Config* Unwrap(v8::Local<v8::Value> value);
+
+    void ApplyTo(TidyDoc target) const;
+
+    // Hands out an idle document configured by this preset,
+    // or a new one if there is none.
+    Doc* Acquire();
+
+    // Takes a document back after a job, keeping at most poolSize.
+    // The job must have dropped the tree already, see shouldDropTree.
+    void Release(Doc* item);
+
+  private:
+    Config();
+    ~Config();
+
+    TidyDoc doc;
+    Buf err;
+    std::vector<Doc*> idle;
+    unsigned poolSize;
+
+    static NAN_METHOD(New);
+    static NAN_METHOD(optGet);
+    static NAN_METHOD(getOptions);
+    static NAN_METHOD(tidy);
+    static NAN_METHOD(tidySync);
+    static NAN_GETTER(getPoolSize);
+    static NAN_SETTER(setPoolSize);
+    static NAN_GETTER(getIdle);
+  };
+
+}
@@ -4,8 +4,6 @@
 
 namespace node_libtidy {
 
-  Nan::Persistent<v8::Function> Doc::constructor;
-
   NAN_MODULE_INIT(Doc::Init) {
     v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
     tpl->SetClassName(Nan::New("TidyDoc").ToLocalChecked());
@@ -23,31 +21,59 @@ namespace node_libtidy {
     Nan::SetPrototypeMethod(tpl, "optGetDoc", optGetDoc);
     Nan::SetPrototypeMethod(tpl, "optGetDocLinksList", optGetDocLinksList);
     Nan::SetPrototypeMethod(tpl, "optResetToDefault", optResetToDefault);
+    Nan::SetPrototypeMethod(tpl, "getOptions", getOptions);
+    Nan::SetPrototypeMethod(tpl, "setOptions", setOptions);
+    Nan::SetPrototypeMethod(tpl, "optionsHash", optionsHash);
+    Nan::SetPrototypeMethod(tpl, "applyConfig", applyConfig);
     Nan::SetPrototypeMethod(tpl, "_async2", async);
+    Nan::SetPrototypeMethod(tpl, "_batch2", batch);
+    Nan::SetPrototypeMethod(tpl, "_fragments2", fragments);
+    Nan::SetPrototypeMethod(tpl, "_sync2", sync);
+    Nan::SetPrototypeMethod(tpl, "abort", abort);
     Nan::SetPrototypeMethod(tpl, "getErrorLog", getErrorLog);
+    Nan::SetPrototypeMethod(tpl, "collectMessages", collectMessages);
+    Nan::SetPrototypeMethod(tpl, "getMessages", getMessages);
+    Nan::SetPrototypeMethod(tpl, "getTree", getTree);
 
-    constructor.Reset(Nan::GetFunction(tpl).ToLocalChecked());
+    tpl = Instance::Keep(Instance::Current()->docTemplate, tpl);
     Nan::Set(target, Nan::New("TidyDoc").ToLocalChecked(),
              Nan::GetFunction(tpl).ToLocalChecked());
   }
 
-  Doc::Doc() : locked(false) {
-    doc = tidyCreateWithAllocator(&allocator);
+  Doc::Doc(bool arena) : alloc(arena), locked(false), parsed(false),
+                           quiet(false), job(NULL) {
+    doc = tidyCreateWithAllocator(&alloc);
+    InstallFilter();
   }
 
   Doc::~Doc() {
+    for (std::set<TidyJob*>::iterator i = spawned.begin(),
+           e = spawned.end(); i != e; ++i)
+      (*i)->origin = NULL;
     tidyRelease(doc);
   }
 
+  // arguments:
+  // 0 - optional object with the following optional properties:
+  //     arena - boolean whether to use an arena allocator
   NAN_METHOD(Doc::New) {
     if (info.IsConstructCall()) {
-      Doc *obj = new Doc();
+      bool arena = false;
+      if (info[0]->IsObject()) {
+        v8::Local<v8::Value> val =
+          Nan::Get(info[0].As<v8::Object>(),
+                   Nan::New("arena").ToLocalChecked()).ToLocalChecked();
+        arena = Nan::To<bool>(val).FromJust();
+      }
+      Doc *obj = new Doc(arena);
       obj->Wrap(info.This());
       info.GetReturnValue().Set(info.This());
     } else {
       const int argc = 1;
       v8::Local<v8::Value> argv[argc] = {info[0]};
-      v8::Local<v8::Function> cons = Nan::New(constructor);
+      v8::Local<v8::Function> cons =
+        Nan::GetFunction(Nan::New(Instance::Current()->docTemplate))
+        .ToLocalChecked();
       info.GetReturnValue().Set
         (Nan::NewInstance(cons, argc, argv).ToLocalChecked());
     }
@@ -59,19 +85,85 @@ namespace node_libtidy {
       Nan::ThrowError("TidyDoc is locked for asynchroneous use.");
       return NULL;
     }
-    doc->err.reset();
-    // Error buffer will get turned into a string, so use LF only there
-    int nl = tidyOptGetInt(doc->doc, TidyNewline);
-    tidyOptSetInt(doc->doc, TidyNewline, TidyLF);
-    int rc = tidySetErrorBuffer(doc->doc, doc->err);
-    tidyOptSetInt(doc->doc, TidyNewline, nl);
-    if (rc) {
+    if (!doc->ResetErrorBuffer()) {
       Nan::ThrowError("Error calling tidySetErrorBuffer");
       return NULL;
     }
     return doc;
   };
 
+  void Doc::InstallFilter() {
+    tidySetAppData(doc, this);
+    tidySetReportFilter(doc, TextFilter);
+    tidySetReportFilter3(doc, ReportFilter);
+  }
+
+  // Tidy combines the result of this filter with that of the next one
+  // using a logical or, so suppressing the text log needs both.
+  Bool TIDY_CALL Doc::TextFilter(TidyDoc tdoc, TidyReportLevel,
+                                 uint, uint, ctmbstr) {
+    Doc* doc = static_cast<Doc*>(tidyGetAppData(tdoc));
+    return bb(!doc->quiet && !doc->messages.isEnabled());
+  }
+
+  // May be called on a worker thread, so it must not touch V8.
+  Bool TIDY_CALL Doc::ReportFilter(TidyDoc tdoc, TidyReportLevel lvl,
+                                   uint line, uint col, ctmbstr code,
+                                   va_list) {
+    Doc* doc = static_cast<Doc*>(tidyGetAppData(tdoc));
+    if (doc->quiet) return no;
+    return bb(doc->messages.report(lvl, line, col, code));
+  }
+
+  bool Doc::ResetErrorBuffer() {
+    err.reset();
+    messages.reset();
+    // Error buffer will get turned into a string, so use LF only there
+    int nl = tidyOptGetInt(doc, TidyNewline);
+    tidyOptSetInt(doc, TidyNewline, TidyLF);
+    int rc = tidySetErrorBuffer(doc, err);
+    tidyOptSetInt(doc, TidyNewline, nl);
+    return rc == 0;
+  }
+
+  // Tidy frees the previous tree when parsing again,
+  // but in an arena that would not return any memory.
+  // So start over with a fresh document, copying the configuration,
+  // and drop the old document together with its whole arena.
+  // This may happen on a worker thread, so it must not touch V8.
+  void Doc::BeforeParse() {
+    if (parsed && alloc.isArena()) {
+      DocAllocator::Chunk* chunks = alloc.detach();
+      TidyDoc old = doc;
+      doc = tidyCreateWithAllocator(&alloc);
+      tidyOptCopyConfig(doc, old);
+      InstallFilter();
+      tidyRelease(old);
+      DocAllocator::release(chunks);
+      ResetErrorBuffer();
+    }
+    parsed = true;
+  }
+
+  // Drops the document tree, so that an idle document stays small.
+  // Tidy has no call for this, but parsing an empty document frees the
+  // previous tree and leaves only a minimal one.
+  // The messages of that parse are suppressed, so that the error log
+  // and the messages of the job remain intact.
+  // Called on the worker thread at the end of a job.
+  void Doc::DropTree() {
+    quiet = true;
+    tidyParseString(doc, "");
+    quiet = false;
+  }
+
+  // Prepares a document for the pool of a Config, once its job is done
+  // and its tree got dropped on the worker thread.
+  void Doc::Recycle() {
+    err.reset();
+    parsed = false;
+  }
+
   bool Doc::CheckResult(int rc, const char* functionName) {
     if (rc < 0) { // Serious problem, probably rc == -errno
       std::ostringstream buf;
@@ -91,6 +183,7 @@ namespace node_libtidy {
       Nan::ThrowTypeError("Argument to parseBufferSync must be a buffer");
       return;
     }
+    doc->BeforeParse();
     TidyBuffer inbuf;
     tidyBufInitWithAllocator(&inbuf, &allocator);
     tidyBufAttach(&inbuf, c2b(node::Buffer::Data(info[0])),
@@ -136,44 +229,7 @@ namespace node_libtidy {
   }
 
   TidyOption Doc::asOption(v8::Local<v8::Value> key) {
-    TidyOption opt = NULL;
-    {
-      Nan::TryCatch tryCatch;
-      opt = Opt::Unwrap(key);
-      if (opt || !tryCatch.CanContinue()) return opt;
-    }
-    if (key->IsNumber()) {
-      double dnum = Nan::To<double>(key).FromJust();
-      int inum = dnum;
-      if (dnum != inum) {
-        Nan::ThrowTypeError("Option id must be an integer");
-      } else if (inum <= 0 || inum > N_TIDY_OPTIONS) {
-        Nan::ThrowRangeError("Option id outside range of allowed options");
-      } else {
-        opt = tidyGetOption(doc, TidyOptionId(inum));
-        if (!opt) {
-          Nan::ThrowError("No option with this id");
-        }
-      }
-      return opt;
-    }
-    Nan::Utf8String str1(key);
-    std::string str2(*str1, str1.length());
-    for (std::string::size_type i = str2.length() - 1; i > 0; --i) {
-      if (str2[i] == '_') str2[i] = '-';
-      if (str2[i] >= 'A' && str2[i] <= 'Z' &&
-          str2[i - 1] >= 'a' && str2[i - 1] <= 'z') {
-        str2[i] = str2[i] + ('a' - 'A');
-        str2.insert(i, 1, '-');
-      }
-    }
-    opt = tidyGetOptionByName(doc, str2.c_str());
-    if (!opt) {
-      std::ostringstream buf;
-      buf << "Option '" << str2 << "' unknown";
-      Nan::ThrowError(NewString(buf.str()));
-    }
-    return opt;
+    return Opt::Resolve(doc, key);
   }
 
   NAN_METHOD(Doc::getOption) {
@@ -187,62 +243,14 @@ namespace node_libtidy {
     Doc* doc = Prelude(info.Holder()); if (!doc) return;
     TidyOption opt = doc->asOption(info[0]);
     if (!opt) return;
-    TidyOptionId id = tidyOptGetId(opt);
-    const char* str;
-    switch (tidyOptGetType(opt)) {
-    case TidyBoolean:
-      info.GetReturnValue().Set(Nan::New<v8::Boolean>
-                                (bb(tidyOptGetBool(doc->doc, id))));
-      break;
-    case TidyInteger:
-      str = tidyOptGetCurrPick(doc->doc, tidyOptGetId(opt));
-      if (str)
-        info.GetReturnValue().Set(Nan::New<v8::String>(str).ToLocalChecked());
-      else
-        info.GetReturnValue().Set(Nan::New<v8::Number>
-                                  (tidyOptGetInt(doc->doc, id)));
-      break;
-    default:
-      str = tidyOptGetValue(doc->doc, id);
-      if (str)
-        info.GetReturnValue().Set(Nan::New<v8::String>(str).ToLocalChecked());
-      else
-        info.GetReturnValue().Set(Nan::Null());
-    }
+    info.GetReturnValue().Set(Opt::Get(doc->doc, opt));
   }
 
   NAN_METHOD(Doc::optSet) {
     Doc* doc = Prelude(info.Holder()); if (!doc) return;
     TidyOption opt = doc->asOption(info[0]);
     if (!opt) return;
-    if (tidyOptIsReadOnly(opt) != no) {
-      std::ostringstream buf;
-      buf << "Option '" << tidyOptGetName(opt) << "' is readonly";
-      Nan::ThrowError(NewString(buf.str()));
-      return;
-    }
-    TidyOptionId id = tidyOptGetId(opt);
-    v8::Local<v8::Value> val = info[1];
-    Bool rc;
-    if (val->IsBoolean() && tidyOptGetType(opt) == TidyBoolean) {
-      rc = tidyOptSetBool(doc->doc, id, bb(Nan::To<bool>(info[1]).FromJust()));
-    } else if (val->IsNumber() && tidyOptGetType(opt) == TidyInteger) {
-      rc = tidyOptSetInt(doc->doc, id, Nan::To<double>(info[1]).FromJust());
-    } else if (val->IsNull() || val->IsUndefined()) {
-      rc = tidyOptSetValue(doc->doc, id, "");
-    } else {
-      Nan::Utf8String str(val);
-      rc = tidyOptSetValue(doc->doc, id, *str);
-    }
-    if (rc != yes) {
-      std::ostringstream buf;
-      buf << "Failed to set option '" << tidyOptGetName(opt)
-          << "' to value '" << Nan::Utf8String(info[1]) << "'";
-      if (!doc->err.isEmpty()) {
-        buf << " - " << doc->err;
-      }
-      Nan::ThrowError(NewString(trim(buf.str())));
-    }
+    Opt::Set(doc->doc, opt, info[1], doc->err);
   }
 
   NAN_METHOD(Doc::optGetCurrPick) {
@@ -289,19 +297,72 @@ namespace node_libtidy {
   }
 
   // arguments:
-  // 0 - input buffer or null if already parsed
+  // 0 - optional boolean whether to only include options
+  //     which are writable and differ from their default
+  NAN_METHOD(Doc::getOptions) {
+    Doc* doc = Prelude(info.Holder()); if (!doc) return;
+    bool changedOnly = Nan::To<bool>(info[0]).FromJust();
+    info.GetReturnValue().Set(Opt::GetAll(doc->doc, changedOnly));
+  }
+
+  // arguments:
+  // 0 - dictionary of options, with keys in any of the formats
+  //     accepted by optSet
+  NAN_METHOD(Doc::setOptions) {
+    Doc* doc = Prelude(info.Holder()); if (!doc) return;
+    if (!info[0]->IsObject()) {
+      Nan::ThrowTypeError("Argument to setOptions must be an object");
+      return;
+    }
+    Opt::SetAll(doc->doc, info[0].As<v8::Object>(), doc->err);
+  }
+
+  // Hash of all option values, as used by the result cache,
+  // for telling whether results of earlier runs still apply
+  NAN_METHOD(Doc::optionsHash) {
+    Doc* doc = Prelude(info.Holder()); if (!doc) return;
+    info.GetReturnValue().Set(Cache::HashString(Cache::HashOptions(doc->doc)));
+  }
+
+  // arguments:
+  // 0 - TidyConfig whose options replace all options of the document
+  NAN_METHOD(Doc::applyConfig) {
+    Doc* doc = Prelude(info.Holder()); if (!doc) return;
+    Config* config = Config::Unwrap(info[0]);
+    if (!config) {
+      Nan::ThrowTypeError("Argument to applyConfig must be a TidyConfig");
+      return;
+    }
+    config->ApplyTo(doc->doc);
+  }
+
+  // arguments:
+  // 0 - input buffer, TidyInputStream, name of a file to read,
+  //     or null if already parsed
   // 1 - boolean whether to call tidyCleanAndRepair
   // 2 - boolean whether to call tidyRunDiagnostics
-  // 3 - boolean whether to save the output to a buffer
+  // 3 - boolean whether to save the output to a buffer,
+  //     TidyOutputStream to save the output to,
+  //     or name of a file to write the output to
   // 4 - resolve callback to invoke once we are done successfully
   // 5 - reject callback to invoke if there was an error
+  // 6 - optional object holding job settings, usually the TidyDoc itself:
+  //     priority - jobs with higher priority leave the pool queue first
+  //     timeout - milliseconds the job may run before it gets aborted
+  //     memoryLimit - bytes the document may hold before the job fails
+  //     extract - query for attribute values to extract after cleaning,
+  //               see Extract::configure
+  //     cache - whether the result cache may answer the job,
+  //             see TidyWorker::fromCache
   NAN_METHOD(Doc::async) {
     Doc* doc = Prelude(info.Holder()); if (!doc) return;
-    if (info.Length() != 6) {
-      Nan::ThrowTypeError("_async2 must be called with exactly 6 arguments.");
+    if (info.Length() != 6 && info.Length() != 7) {
+      Nan::ThrowTypeError("_async2 must be called with 6 or 7 arguments.");
       return;
     }
-    if (!(info[0]->IsNull() || node::Buffer::HasInstance(info[0]))) {
+    InputStream* stream = InputStream::Unwrap(info[0]);
+    if (!(info[0]->IsNull() || stream || info[0]->IsString() ||
+          node::Buffer::HasInstance(info[0]))) {
       Nan::ThrowTypeError("First argument to _async2 must be a buffer");
       return;
     }
@@ -313,18 +374,221 @@ namespace node_libtidy {
       Nan::ThrowTypeError("Reject argument to _async2 must be a function");
       return;
     }
+    JobSettings settings(info[6]);
     TidyWorker* w = new TidyWorker(doc,
                                    info[4].As<v8::Function>(),
                                    info[5].As<v8::Function>());
+    w->setLimits(settings);
+    if (settings.hasSkipHash)
+      w->skipIfHash(settings.skipHash);
     w->SaveToPersistent(0u, info.Holder());
-    if (!info[0]->IsNull()) {
+    if (stream) {
+      w->SaveToPersistent(1u, info[0]);
+      w->setInput(stream);
+    } else if (info[0]->IsString()) {
+      Nan::Utf8String path(info[0]);
+      w->setInputFile(std::string(*path, path.length()));
+    } else if (!info[0]->IsNull()) {
       w->SaveToPersistent(1u, info[0]);
       w->setInput(node::Buffer::Data(info[0]), node::Buffer::Length(info[0]));
     }
     w->shouldCleanAndRepair = Nan::To<bool>(info[1]).FromJust();
     w->shouldRunDiagnostics = Nan::To<bool>(info[2]).FromJust();
-    w->shouldSaveToBuffer = Nan::To<bool>(info[3]).FromJust();
-    Nan::AsyncQueueWorker(w);
+    if (info[6]->IsObject()) {
+      v8::Local<v8::Value> query =
+        Nan::Get(info[6].As<v8::Object>(),
+                 Nan::New("extract").ToLocalChecked()).ToLocalChecked();
+      if (!query->IsUndefined()) {
+        if (!w->extraction.configure(query)) {
+          delete w;
+          doc->Unlock();
+          return;
+        }
+        w->shouldExtract = true;
+      }
+    }
+    OutputStream* sink = OutputStream::Unwrap(info[3]);
+    if (sink) {
+      w->SaveToPersistent(2u, info[3]);
+      w->setOutput(sink);
+      w->shouldSaveToBuffer = false;
+    } else if (info[3]->IsString()) {
+      Nan::Utf8String path(info[3]);
+      w->setOutputFile(std::string(*path, path.length()));
+      w->shouldSaveToBuffer = false;
+    } else {
+      w->shouldSaveToBuffer = Nan::To<bool>(info[3]).FromJust();
+    }
+    if (w->fromCache(settings)) {
+      delete w;
+      return;
+    }
+    if (!Pool::Queue(w, settings.priority)) {
+      delete w;
+      doc->Unlock();
+      Nan::ThrowError("Tidy job queue is full");
+    }
+  }
+
+  // arguments:
+  // 0 - input buffer, or null if already parsed
+  // 1 - boolean whether to call tidyCleanAndRepair
+  // 2 - boolean whether to call tidyRunDiagnostics
+  // 3 - boolean whether to save the output to a buffer
+  // 4 - optional object holding job settings, as for _async2
+  //     except for priority
+  // Runs all the phases on the calling thread, with a single error buffer,
+  // and returns the result _async2 would resolve to.
+  NAN_METHOD(Doc::sync) {
+    Doc* doc = Prelude(info.Holder()); if (!doc) return;
+    if (info.Length() != 4 && info.Length() != 5) {
+      Nan::ThrowTypeError("_sync2 must be called with 4 or 5 arguments.");
+      return;
+    }
+    if (!(info[0]->IsNull() || node::Buffer::HasInstance(info[0]))) {
+      Nan::ThrowTypeError("First argument to _sync2 must be a buffer");
+      return;
+    }
+    JobSettings settings(info[4]);
+    TidyJob job(doc);
+    job.setLimits(settings);
+    if (!info[0]->IsNull())
+      job.setInput(node::Buffer::Data(info[0]), node::Buffer::Length(info[0]));
+    job.shouldCleanAndRepair = Nan::To<bool>(info[1]).FromJust();
+    job.shouldRunDiagnostics = Nan::To<bool>(info[2]).FromJust();
+    job.shouldSaveToBuffer = Nan::To<bool>(info[3]).FromJust();
+    if (info[4]->IsObject()) {
+      v8::Local<v8::Value> query =
+        Nan::Get(info[4].As<v8::Object>(),
+                 Nan::New("extract").ToLocalChecked()).ToLocalChecked();
+      if (!query->IsUndefined()) {
+        if (!job.extraction.configure(query)) {
+          doc->Unlock();
+          return;
+        }
+        job.shouldExtract = true;
+      }
+    }
+    v8::Local<v8::Value> res = job.RunSync(settings);
+    if (!res.IsEmpty())
+      info.GetReturnValue().Set(res);
+  }
+
+  // arguments:
+  // 0 - array of input buffers
+  // 1 - resolve callback to invoke with the array of results
+  // 2 - reject callback to invoke if there was an error
+  // 3 - optional object holding job settings, as for _async2,
+  //     plus an optional lint property: if true, the output is not saved
+  NAN_METHOD(Doc::batch) {
+    Doc* doc = Prelude(info.Holder()); if (!doc) return;
+    if (info.Length() != 3 && info.Length() != 4) {
+      Nan::ThrowTypeError("_batch2 must be called with 3 or 4 arguments.");
+      return;
+    }
+    if (!info[0]->IsArray()) {
+      Nan::ThrowTypeError("First argument to _batch2 must be an array");
+      return;
+    }
+    if (!info[1]->IsFunction()) {
+      Nan::ThrowTypeError("Resolve argument to _batch2 must be a function");
+      return;
+    }
+    if (!info[2]->IsFunction()) {
+      Nan::ThrowTypeError("Reject argument to _batch2 must be a function");
+      return;
+    }
+    v8::Local<v8::Array> inputs = info[0].As<v8::Array>();
+    uint32_t count = inputs->Length();
+    for (uint32_t i = 0; i < count; ++i) {
+      if (!node::Buffer::HasInstance(Nan::Get(inputs, i).ToLocalChecked())) {
+        Nan::ThrowTypeError("Elements of first argument to _batch2 "
+                            "must be buffers");
+        return;
+      }
+    }
+    JobSettings settings(info[3]);
+    bool lint = false;
+    if (info[3]->IsObject()) {
+      v8::Local<v8::Value> val =
+        Nan::Get(info[3].As<v8::Object>(),
+                 Nan::New("lint").ToLocalChecked()).ToLocalChecked();
+      lint = Nan::To<bool>(val).FromJust();
+    }
+    Batch* b = new Batch(doc, info.Holder(), inputs, settings, lint,
+                         info[1].As<v8::Function>(),
+                         info[2].As<v8::Function>());
+    b->Fill();
+  }
+
+  // arguments:
+  // 0 - array of buffers, each holding a fragment of a body
+  // 1 - resolve callback to invoke with the array of results
+  // 2 - reject callback to invoke if there was an error
+  // 3 - optional object holding job settings, as for _async2
+  // The fragments get tidied as one document on a copy of the options,
+  // always printing only the body and always collecting messages.
+  // Each result holds output and messages of one fragment,
+  // with lines counted from its start.
+  NAN_METHOD(Doc::fragments) {
+    Doc* doc = Prelude(info.Holder()); if (!doc) return;
+    if (info.Length() != 3 && info.Length() != 4) {
+      Nan::ThrowTypeError("_fragments2 must be called with 3 or 4 arguments.");
+      return;
+    }
+    if (!info[1]->IsFunction()) {
+      Nan::ThrowTypeError("Resolve argument to _fragments2 "
+                          "must be a function");
+      return;
+    }
+    if (!info[2]->IsFunction()) {
+      Nan::ThrowTypeError("Reject argument to _fragments2 "
+                          "must be a function");
+      return;
+    }
+    JobSettings settings(info[3]);
+    Doc* item = new Doc(doc->isArena());
+    tidyOptCopyConfig(item->doc, doc->doc);
+    tidyOptSetInt(item->doc, TidyBodyOnly, TidyYesState);
+    item->messages.configure(doc->messages);
+    if (!item->messages.isEnabled())
+      item->messages.configure(Nan::True());
+    item->ResetErrorBuffer();
+    FragmentWorker* w = new FragmentWorker(item,
+                                           info[1].As<v8::Function>(),
+                                           info[2].As<v8::Function>());
+    if (!w->fragments.configure(info[0])) {
+      delete w;
+      return;
+    }
+    w->setOrigin(doc);
+    bool combinable = w->fragments.combinable(item->doc);
+    if (combinable)
+      w->setInput(w->fragments.data(), w->fragments.length());
+    w->setLimits(settings);
+    w->shouldCleanAndRepair = combinable;
+    w->shouldRunDiagnostics = combinable;
+    w->shouldSaveToBuffer = combinable;
+    w->shouldSplitFragments = true;
+    if (!Pool::Queue(w, settings.priority)) {
+      delete w;
+      Nan::ThrowError("Tidy job queue is full");
+    }
+  }
+
+  // Aborts the asynchroneous job currently holding the document,
+  // as well as any batch jobs working on copies of it,
+  // which then get rejected with an error whose code is ABORT_ERR.
+  // Returns whether there was such a job.
+  NAN_METHOD(Doc::abort) {
+    Doc* doc = Nan::ObjectWrap::Unwrap<Doc>(info.Holder());
+    if (doc->job)
+      doc->job->Abort();
+    for (std::set<TidyJob*>::iterator i = doc->spawned.begin(),
+           e = doc->spawned.end(); i != e; ++i)
+      (*i)->Abort();
+    info.GetReturnValue().Set(
+      Nan::New(doc->job != NULL || !doc->spawned.empty()));
   }
 
   NAN_METHOD(Doc::getErrorLog) {
@@ -336,4 +600,36 @@ namespace node_libtidy {
     info.GetReturnValue().Set(doc->err.string().ToLocalChecked());
   }
 
+  // arguments:
+  // 0 - false to go back to the text error log, true to collect all
+  //     messages as records, or object with optional properties
+  //     levels, include and exclude to filter the collected messages
+  NAN_METHOD(Doc::collectMessages) {
+    Doc* doc = Prelude(info.Holder()); if (!doc) return;
+    doc->messages.configure(info[0]);
+  }
+
+  NAN_METHOD(Doc::getMessages) {
+    Doc* doc = Nan::ObjectWrap::Unwrap<Doc>(info.Holder());
+    if (doc->locked) {
+      Nan::ThrowError("TidyDoc is locked for asynchroneous use.");
+      return;
+    }
+    if (doc->messages.isEnabled())
+      info.GetReturnValue().Set(doc->messages.result());
+    else
+      info.GetReturnValue().Set(Nan::Null());
+  }
+
+  // Returns the parsed tree in the flat layout described in tree.hh
+  NAN_METHOD(Doc::getTree) {
+    Doc* doc = Nan::ObjectWrap::Unwrap<Doc>(info.Holder());
+    if (doc->locked) {
+      Nan::ThrowError("TidyDoc is locked for asynchroneous use.");
+      return;
+    }
+    Tree tree(doc->doc);
+    info.GetReturnValue().Set(tree.result());
+  }
+
 }
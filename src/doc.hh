@@ -1,24 +1,44 @@
 namespace node_libtidy {
 
+  class TidyJob;
+
   class Doc : public Nan::ObjectWrap {
   public:
-    Doc();
+    explicit Doc(bool arena = false);
     ~Doc();
 
     TidyOption asOption(v8::Local<v8::Value> value);
     bool CheckResult(int rc, const char* functionName);
+    bool ResetErrorBuffer();
+    void BeforeParse();
+    void DropTree();
+    void Recycle();
+    bool isArena() const { return alloc.isArena(); }
     v8::Local<v8::Value> exception(int rc);
-    void Lock() { locked = true; }
-    void Unlock() { locked = false; }
+    void Lock(TidyJob* job) { locked = true; this->job = job; }
+    void Unlock() { locked = false; job = NULL; }
 
     static NAN_MODULE_INIT(Init);
 
   private:
+    DocAllocator alloc;
     TidyDoc doc;
     Buf err;
+    Messages messages;
     bool locked;
+    bool parsed;
+    bool quiet; // suppresses all messages while dropping the tree
+    TidyJob* job; // the job holding the lock, if any
+    // Jobs on copies of the document, which get aborted along with it
+    std::set<TidyJob*> spawned;
 
     static Doc* Prelude(v8::Local<v8::Object> self);
+    void InstallFilter();
+    static Bool TIDY_CALL TextFilter(TidyDoc tdoc, TidyReportLevel lvl,
+                                     uint line, uint col, ctmbstr mssg);
+    static Bool TIDY_CALL ReportFilter(TidyDoc tdoc, TidyReportLevel lvl,
+                                       uint line, uint col, ctmbstr code,
+                                       va_list args);
 
     static NAN_METHOD(New);
     static NAN_METHOD(parseBufferSync);
@@ -33,12 +53,23 @@ namespace node_libtidy {
     static NAN_METHOD(optGetDoc);
     static NAN_METHOD(optGetDocLinksList);
     static NAN_METHOD(optResetToDefault);
+    static NAN_METHOD(getOptions);
+    static NAN_METHOD(setOptions);
+    static NAN_METHOD(optionsHash);
+    static NAN_METHOD(applyConfig);
     static NAN_METHOD(async);
+    static NAN_METHOD(batch);
+    static NAN_METHOD(fragments);
+    static NAN_METHOD(sync);
+    static NAN_METHOD(abort);
     static NAN_METHOD(getErrorLog);
+    static NAN_METHOD(collectMessages);
+    static NAN_METHOD(getMessages);
+    static NAN_METHOD(getTree);
 
-    static Nan::Persistent<v8::Function> constructor;
-
-    friend class TidyWorker;
+    friend class TidyJob;
+    friend class Config;
+    friend class Batch;
   };
 
 }
@@ -0,0 +1,114 @@
+#include "node-libtidy.hh"
+
+#include <cctype>
+#include <sstream>
+
+namespace node_libtidy {
+
+  namespace {
+
+    // Tidy reports HTML names in lower case
+    std::string lower(std::string str) {
+      for (size_t i = 0; i < str.length(); ++i)
+        str[i] = std::tolower(static_cast<unsigned char>(str[i]));
+      return str;
+    }
+
+    bool GetNames(v8::Local<v8::Object> query, const char* key,
+                  std::set<std::string>& out) {
+      v8::Local<v8::Value> val =
+        Nan::Get(query, Nan::New(key).ToLocalChecked()).ToLocalChecked();
+      if (val->IsUndefined()) return true;
+      if (!val->IsArray()) {
+        std::ostringstream buf;
+        buf << "Extract query '" << key << "' must be an array";
+        Nan::ThrowTypeError(NewString(buf.str()));
+        return false;
+      }
+      v8::Local<v8::Array> arr = val.As<v8::Array>();
+      for (uint32_t i = 0, n = arr->Length(); i < n; ++i) {
+        Nan::Utf8String str(Nan::Get(arr, i).ToLocalChecked());
+        out.insert(lower(std::string(*str, str.length())));
+      }
+      return true;
+    }
+
+  }
+
+  // arguments:
+  // query - object with the following optional properties:
+  //         tags - array of element names, defaults to all elements
+  //         attrs - array of attribute names, defaults to all attributes
+  bool Extract::configure(v8::Local<v8::Value> query) {
+    if (!query->IsObject()) {
+      Nan::ThrowTypeError("Extract query must be an object");
+      return false;
+    }
+    v8::Local<v8::Object> obj = query.As<v8::Object>();
+    return GetNames(obj, "tags", tags) && GetNames(obj, "attrs", attrs);
+  }
+
+  // Visits the nodes in document order without recursion
+  void Extract::run(TidyDoc doc) {
+    TidyNode node = tidyGetRoot(doc);
+    while (node) {
+      TidyAttr attr = tidyAttrFirst(node);
+      ctmbstr tag = attr ? tidyNodeGetName(node) : NULL;
+      if (tag && (tags.empty() || tags.count(tag))) {
+        for (; attr; attr = tidyAttrNext(attr)) {
+          ctmbstr attrName = tidyAttrName(attr);
+          ctmbstr value = tidyAttrValue(attr);
+          if (!attrName || !value) continue;
+          if (!attrs.empty() && !attrs.count(attrName)) continue;
+          Match match;
+          match.tag = name(tag);
+          match.attr = name(attrName);
+          match.value = value;
+          match.line = tidyNodeLine(node);
+          match.column = tidyNodeColumn(node);
+          matches.push_back(match);
+        }
+      }
+      TidyNode next = tidyGetChild(node);
+      while (!next && node) {
+        next = tidyGetNext(node);
+        if (!next)
+          node = tidyGetParent(node);
+      }
+      node = next;
+    }
+  }
+
+  int32_t Extract::name(ctmbstr str) {
+    std::string key(str);
+    std::map<std::string, int32_t>::iterator i = nameIndex.find(key);
+    if (i != nameIndex.end()) return i->second;
+    int32_t index = names.size();
+    names.push_back(key);
+    nameIndex.insert(std::make_pair(key, index));
+    return index;
+  }
+
+  v8::Local<v8::Array> Extract::result() const {
+    Nan::EscapableHandleScope scope;
+    // Each name becomes a single JavaScript string shared by all matches
+    std::vector<v8::Local<v8::String> > strings;
+    for (size_t i = 0; i < names.size(); ++i)
+      strings.push_back(NewString(names[i]));
+    v8::Local<v8::Array> arr = Nan::New<v8::Array>(matches.size());
+    for (size_t i = 0; i < matches.size(); ++i) {
+      const Match& m = matches[i];
+      v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+      Nan::Set(obj, Nan::New("tag").ToLocalChecked(), strings[m.tag]);
+      Nan::Set(obj, Nan::New("attr").ToLocalChecked(), strings[m.attr]);
+      Nan::Set(obj, Nan::New("value").ToLocalChecked(), NewString(m.value));
+      Nan::Set(obj, Nan::New("line").ToLocalChecked(),
+               Nan::New<v8::Uint32>(m.line));
+      Nan::Set(obj, Nan::New("column").ToLocalChecked(),
+               Nan::New<v8::Uint32>(m.column));
+      Nan::Set(arr, i, obj);
+    }
+    return scope.Escape(arr);
+  }
+
+}
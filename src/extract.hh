@@ -0,0 +1,34 @@
+namespace node_libtidy {
+
+  // Query for the values of selected attributes of selected elements,
+  // e.g. all href and src attributes, evaluated natively on the tree.
+  class Extract {
+  public:
+    // Reads the query from JavaScript; returns false after throwing
+    bool configure(v8::Local<v8::Value> query);
+
+    // Collects all matches; may be called on a worker thread
+    void run(TidyDoc doc);
+
+    // [{tag, attr, value, line, column}] in document order
+    v8::Local<v8::Array> result() const;
+
+  private:
+    struct Match {
+      int32_t tag; // index into names
+      int32_t attr; // index into names
+      std::string value;
+      uint line;
+      uint column;
+    };
+
+    int32_t name(ctmbstr str);
+
+    std::set<std::string> tags; // empty means all elements
+    std::set<std::string> attrs; // empty means all attributes
+    std::vector<std::string> names;
+    std::map<std::string, int32_t> nameIndex;
+    std::vector<Match> matches;
+  };
+
+}
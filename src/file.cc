@@ -0,0 +1,381 @@
+#include "node-libtidy.hh"
+
+#include <cerrno>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace node_libtidy {
+
+  namespace {
+
+    const size_t bufferSize = 64 * 1024;
+
+    // Retries on names taken by other temporary files
+    const int maxAttempts = 100;
+
+    // Temporary file next to the given one, on the same file system
+    std::string TempPath(const std::string& path) {
+      std::ostringstream name;
+      name << path << ".tidy-" << std::hex << uv_hrtime();
+      return name.str();
+    }
+
+#ifdef _WIN32
+
+    int LastError() {
+      return GetLastError();
+    }
+
+    std::wstring Wide(const std::string& str) {
+      int n = MultiByteToWideChar(CP_UTF8, 0, str.data(), int(str.length()),
+                                  NULL, 0);
+      std::wstring res(n, L'\0');
+      if (n)
+        MultiByteToWideChar(CP_UTF8, 0, str.data(), int(str.length()),
+                            &res[0], n);
+      return res;
+    }
+
+#else
+
+    int LastError() {
+      return errno;
+    }
+
+#endif
+
+  }
+
+  void FileError::set(int sysError, const char* syscall,
+                      const std::string& path, const std::string& tempPath) {
+    if (code) return; // keep the first one
+    code = uv_translate_sys_error(sysError);
+    this->syscall = syscall;
+    this->path = path;
+    this->tempPath = tempPath;
+  }
+
+  v8::Local<v8::Value> FileError::exception() const {
+    v8::Local<v8::Value> res =
+      node::UVException(v8::Isolate::GetCurrent(), code, syscall,
+                        NULL, path.c_str());
+    if (!tempPath.empty() && res->IsObject())
+      Nan::Set(res.As<v8::Object>(), Nan::New("tempPath").ToLocalChecked(),
+               Nan::New(tempPath).ToLocalChecked());
+    return res;
+  }
+
+  // The size of the file is only a hint, since it might be changing
+  bool FileContent::grow(size_t min) {
+    size_t n = capacity < min ? min : capacity;
+    if (n == capacity)
+      n = capacity * 2;
+    void* p = buf ? allocator.vtbl->realloc(&allocator, buf, n)
+      : allocator.vtbl->alloc(&allocator, n);
+    if (!p) return false;
+    buf = static_cast<char*>(p);
+    capacity = n;
+    return true;
+  }
+
+  void FileContent::close() {
+    if (buf)
+      allocator.vtbl->free(&allocator, buf);
+    buf = NULL;
+    size = capacity = 0;
+  }
+
+#ifdef _WIN32
+
+  bool FileContent::read(const std::string& path, FileError& err) {
+    HANDLE file = CreateFileW(Wide(path).c_str(), GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE |
+                              FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+      err.set(LastError(), "open", path);
+      return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+      err.set(LastError(), "fstat", path);
+      CloseHandle(file);
+      return false;
+    }
+    // One more byte, so that the end gets noticed without growing
+    if (!grow(size_t(fileSize.QuadPart) + 1)) {
+      err.set(ERROR_NOT_ENOUGH_MEMORY, "read", path);
+      CloseHandle(file);
+      return false;
+    }
+    for (;;) {
+      if (size == capacity && !grow(0)) {
+        err.set(ERROR_NOT_ENOUGH_MEMORY, "read", path);
+        break;
+      }
+      size_t want = capacity - size;
+      DWORD got;
+      if (!ReadFile(file, buf + size,
+                    want > 0x40000000 ? 0x40000000 : DWORD(want),
+                    &got, NULL)) {
+        err.set(LastError(), "read", path);
+        break;
+      }
+      if (got == 0) {
+        CloseHandle(file);
+        return true;
+      }
+      size += got;
+    }
+    CloseHandle(file);
+    close();
+    return false;
+  }
+
+#else
+
+  bool FileContent::read(const std::string& path, FileError& err) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      err.set(LastError(), "open", path);
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st)) {
+      err.set(LastError(), "fstat", path);
+      ::close(fd);
+      return false;
+    }
+    // One more byte, so that the end gets noticed without growing
+    if (!grow(size_t(st.st_size) + 1)) {
+      err.set(ENOMEM, "read", path);
+      ::close(fd);
+      return false;
+    }
+    for (;;) {
+      if (size == capacity && !grow(0)) {
+        err.set(ENOMEM, "read", path);
+        break;
+      }
+      ssize_t got = ::read(fd, buf + size, capacity - size);
+      if (got < 0) {
+        if (errno == EINTR) continue;
+        err.set(LastError(), "read", path);
+        break;
+      }
+      if (got == 0) {
+        ::close(fd);
+        return true;
+      }
+      size += size_t(got);
+    }
+    ::close(fd);
+    close();
+    return false;
+  }
+
+#endif
+
+  FileSink::FileSink(const std::string& path)
+    : path(path), opened(false), committed(false), unchanged(false),
+      handle(-1), cmp(NULL), cmpLength(0), matched(0)
+  {
+    tidyInitSink(&snk, this, putByte);
+  }
+
+  void FileSink::compareWith(const char* data, size_t length) {
+    cmp = data;
+    cmpLength = length;
+    matched = 0;
+  }
+
+  void TIDY_CALL FileSink::putByte(void* data, byte bt) {
+    FileSink* self = static_cast<FileSink*>(data);
+    char c = static_cast<char>(bt);
+    if (self->cmp) {
+      if (self->matched < self->cmpLength && self->cmp[self->matched] == c) {
+        ++self->matched;
+        return;
+      }
+      self->diverge();
+    }
+    if (self->buf.capacity() == 0)
+      self->buf.reserve(bufferSize);
+    self->buf.push_back(c);
+    if (self->buf.size() == bufferSize)
+      self->flush();
+  }
+
+  // The output turned out to differ from what it got compared with,
+  // so the matching part has to be written after all
+  void FileSink::diverge() {
+    const char* data = cmp;
+    size_t length = matched;
+    cmp = NULL;
+    hasher.update(data, length);
+    if (length && open())
+      write(data, length);
+  }
+
+  void FileSink::flush() {
+    hasher.update(buf.data(), buf.size());
+    if (open())
+      write(buf.data(), buf.size());
+    buf.clear();
+  }
+
+  bool FileSink::finish(FileError& err) {
+    if (cmp) {
+      if (matched == cmpLength) {
+        hasher.update(cmp, cmpLength);
+        unchanged = true;
+        cmp = NULL;
+      } else if (matched) { // the output is a prefix of cmp
+        diverge();
+      } else { // there was no output at all
+        cmp = NULL;
+      }
+    }
+    if (!buf.empty())
+      flush();
+    close();
+    if (!error.failed()) return true;
+    err = error;
+    return false;
+  }
+
+#ifdef _WIN32
+
+  FileSink::~FileSink() {
+    FileError ignored;
+    finish(ignored);
+    if (!committed && !tempPath.empty())
+      DeleteFileW(Wide(tempPath).c_str());
+  }
+
+  bool FileSink::open() {
+    if (opened) return handle != -1;
+    opened = true;
+    for (int attempt = 0; ; ++attempt) {
+      tempPath = TempPath(path);
+      HANDLE file = CreateFileW(Wide(tempPath).c_str(), GENERIC_WRITE, 0, NULL,
+                                CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+      if (file != INVALID_HANDLE_VALUE) {
+        handle = reinterpret_cast<intptr_t>(file);
+        return true;
+      }
+      if (GetLastError() != ERROR_FILE_EXISTS || attempt == maxAttempts) {
+        error.set(LastError(), "open", path, tempPath);
+        tempPath.clear();
+        return false;
+      }
+    }
+  }
+
+  void FileSink::write(const char* data, size_t left) {
+    while (handle != -1 && !error.failed() && left) {
+      DWORD written;
+      if (!WriteFile(reinterpret_cast<HANDLE>(handle), data, DWORD(left),
+                     &written, NULL)) {
+        error.set(LastError(), "write", path, tempPath);
+        break;
+      }
+      data += written;
+      left -= written;
+    }
+  }
+
+  void FileSink::close() {
+    if (handle != -1) {
+      if (!CloseHandle(reinterpret_cast<HANDLE>(handle)))
+        error.set(LastError(), "close", path, tempPath);
+      handle = -1;
+    }
+  }
+
+  bool FileSink::commit(FileError& err) {
+    if (!error.failed() && !tempPath.empty() && !committed) {
+      if (MoveFileExW(Wide(tempPath).c_str(), Wide(path).c_str(),
+                      MOVEFILE_REPLACE_EXISTING))
+        committed = true;
+      else
+        error.set(LastError(), "rename", path, tempPath);
+    }
+    if (!error.failed()) return true;
+    err = error;
+    return false;
+  }
+
+#else
+
+  FileSink::~FileSink() {
+    FileError ignored;
+    finish(ignored);
+    if (!committed && !tempPath.empty())
+      ::unlink(tempPath.c_str());
+  }
+
+  bool FileSink::open() {
+    if (opened) return handle >= 0;
+    opened = true;
+    for (int attempt = 0; ; ++attempt) {
+      tempPath = TempPath(path);
+      handle = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+      if (handle >= 0)
+        break;
+      if (errno != EEXIST || attempt == maxAttempts) {
+        error.set(LastError(), "open", path, tempPath);
+        tempPath.clear();
+        return false;
+      }
+    }
+    // A replaced file keeps its permissions
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0)
+      fchmod(int(handle), st.st_mode & 07777);
+    return true;
+  }
+
+  void FileSink::write(const char* data, size_t left) {
+    while (handle >= 0 && !error.failed() && left) {
+      ssize_t written = ::write(int(handle), data, left);
+      if (written < 0) {
+        if (errno == EINTR) continue;
+        error.set(LastError(), "write", path, tempPath);
+        break;
+      }
+      data += written;
+      left -= written;
+    }
+  }
+
+  void FileSink::close() {
+    if (handle >= 0) {
+      if (::close(int(handle)))
+        error.set(LastError(), "close", path, tempPath);
+      handle = -1;
+    }
+  }
+
+  bool FileSink::commit(FileError& err) {
+    if (!error.failed() && !tempPath.empty() && !committed) {
+      if (::rename(tempPath.c_str(), path.c_str()))
+        error.set(LastError(), "rename", path, tempPath);
+      else
+        committed = true;
+    }
+    if (!error.failed()) return true;
+    err = error;
+    return false;
+  }
+
+#endif
+
+}
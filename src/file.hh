@@ -0,0 +1,108 @@
+namespace node_libtidy {
+
+  // Failure of a file operation on a worker thread,
+  // reported on the main thread like the errors of the fs module.
+  class FileError {
+  public:
+    FileError() : code(0), syscall(NULL) { }
+
+    // Takes errno, or GetLastError on Windows.
+    // Operations on a temporary file standing in for the file at path
+    // name the former as well.
+    void set(int sysError, const char* syscall, const std::string& path,
+             const std::string& tempPath = std::string());
+
+    bool failed() const { return code != 0; }
+
+    v8::Local<v8::Value> exception() const;
+
+  private:
+    int code; // libuv error code
+    const char* syscall;
+    std::string path;
+    std::string tempPath;
+  };
+
+  // A whole file read into native memory on the worker thread,
+  // so that its content never has to be copied into the V8 heap.
+  // It isn't mapped, since touching a mapping of a file which another
+  // process truncated meanwhile raises SIGBUS, killing the process.
+  // Editors saving a file and redirections truncate it first,
+  // so that happens easily when watching files.
+  class FileContent {
+  public:
+    FileContent() : buf(NULL), size(0), capacity(0) { }
+    ~FileContent() { close(); }
+
+    bool read(const std::string& path, FileError& err);
+    void close();
+
+    const char* data() const { return buf; }
+    size_t length() const { return size; }
+
+  private:
+    bool grow(size_t min);
+
+    char* buf;
+    size_t size;
+    size_t capacity;
+  };
+
+  // Output for tidySaveSink, written to a file on the worker thread.
+  // The output goes to a temporary file next to the target,
+  // which only replaces the target once it is complete,
+  // so readers never see a partially written file.
+  // The file only gets created once there is something to write,
+  // so a job which produces no output leaves an existing file alone.
+  // A symbolic link as the target gets replaced, not written through.
+  class FileSink {
+  public:
+    explicit FileSink(const std::string& path);
+    ~FileSink(); // removes the temporary file unless committed
+
+    TidyOutputSink* sink() { return &snk; }
+
+    // Nothing gets written as long as the output matches this data,
+    // usually the input file which the output is about to replace.
+    // It must stay valid until finish.
+    void compareWith(const char* data, size_t length);
+
+    // Writes what is left and closes the temporary file;
+    // returns false if any of the writes failed
+    bool finish(FileError& err);
+
+    // Moves the finished temporary file over the target
+    bool commit(FileError& err);
+
+    // Whether nothing got written, either for lack of output
+    // or because the output was equal to the data it got compared with
+    bool isEmpty() const { return !opened; }
+    bool isUnchanged() const { return unchanged; }
+
+    // Of all the output, whether written or not
+    uint64_t hash() const { return hasher.digest(); }
+
+  private:
+    static void TIDY_CALL putByte(void* data, byte bt);
+    void flush();
+    bool open();
+    void write(const char* data, size_t length);
+    void close();
+    void diverge();
+
+    TidyOutputSink snk;
+    std::string path;
+    std::string tempPath;
+    bool opened;
+    bool committed;
+    bool unchanged;
+    intptr_t handle; // file descriptor, or HANDLE on Windows
+    std::vector<char> buf;
+    const char* cmp; // NULL unless comparing
+    size_t cmpLength;
+    size_t matched; // bytes of output equal to cmp so far
+    Cache::Hasher hasher;
+    FileError error; // the first one, if any
+  };
+
+}
@@ -0,0 +1,324 @@
+#include "node-libtidy.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <random>
+#include <sstream>
+
+namespace node_libtidy {
+
+  namespace {
+
+    const char prologue[] = "<html><head><title></title></head><body>\n";
+    const char epilogue[] = "</body></html>\n";
+
+    // Lines of the prologue, i.e. where the first fragment starts
+    const uint firstLine = 2;
+
+    // XML has no body to put the fragments into
+    bool Wrapped(TidyDoc doc) {
+      return !tidyOptGetBool(doc, TidyXmlTags);
+    }
+
+    // Elements whose content tidy prints as it is,
+    // so that the indentation of the container can't be removed from it
+    const char* const verbatim[] = {
+      "<pre", "<textarea", "<script", "<style",
+    };
+
+    // Tidy counts CR, LF and CRLF as one line break each
+    uint LineBreaks(const char* data, size_t length) {
+      uint n = 0;
+      for (size_t i = 0; i < length; ++i)
+        if (data[i] == '\n' ||
+            (data[i] == '\r' && (i + 1 == length || data[i + 1] != '\n')))
+          ++n;
+      return n;
+    }
+
+    // Text of the comment starting or ending fragment i
+    std::string Marker(const std::string& token, size_t i, bool end) {
+      std::ostringstream buf;
+      buf << (end ? "/" : "") << token << ":" << i;
+      return buf.str();
+    }
+
+    bool IsMarker(TidyDoc doc, TidyNode node, const std::string& text,
+                  TidyBuffer* value) {
+      if (!node || tidyNodeGetType(node) != TidyNode_Comment) return false;
+      tidyBufClear(value);
+      return tidyNodeGetValue(doc, node, value) &&
+        value->size == text.length() &&
+        std::memcmp(value->bp, text.data(), text.length()) == 0;
+    }
+
+    TidyNode LastChild(TidyNode node) {
+      TidyNode child = tidyGetChild(node);
+      for (TidyNode next; child && (next = tidyGetNext(child)); child = next);
+      return child;
+    }
+
+    const char* Find(const char* begin, const char* end,
+                     const std::string& str) {
+      const char* res = std::search(begin, end, str.begin(), str.end());
+      return res == end ? NULL : res;
+    }
+
+    bool ContainsVerbatim(const char* begin, const char* end) {
+      for (const char* p = begin; p != end; ++p) {
+        if (*p != '<') continue;
+        for (size_t i = 0; i < sizeof(verbatim) / sizeof(verbatim[0]); ++i) {
+          const char* tag = verbatim[i];
+          size_t n = std::strlen(tag);
+          size_t k = 1;
+          while (k < n && p + k != end &&
+                 std::tolower(static_cast<unsigned char>(p[k])) == tag[k])
+            ++k;
+          if (k == n) return true;
+        }
+      }
+      return false;
+    }
+
+    const char* Newline(TidyDoc doc) {
+      switch (tidyOptGetInt(doc, TidyNewline)) {
+      case TidyCRLF: return "\r\n";
+      case TidyCR: return "\r";
+      default: return "\n";
+      }
+    }
+
+    // The output between the markers, as if printed outside the container:
+    // without the line break following the start marker,
+    // the indentation preceding the end marker,
+    // and the indentation of the container in front of every line.
+    std::string Unwrap(const char* p, const char* end,
+                       size_t indent, const char* nl) {
+      bool bol = false;
+      if (p != end && *p == '\r') {
+        ++p;
+        bol = true;
+      }
+      if (p != end && *p == '\n') {
+        ++p;
+        bol = true;
+      }
+      while (end != p && (end[-1] == ' ' || end[-1] == '\t'))
+        --end;
+      std::string res;
+      res.reserve(end - p);
+      while (p != end) {
+        if (bol) {
+          size_t k = 0;
+          while (k < indent && p + k != end && p[k] == ' ')
+            ++k;
+          if (k == indent)
+            p += k;
+          bol = false;
+          continue;
+        }
+        char c = *p++;
+        res += c;
+        bol = c == '\n' || (c == '\r' && (p == end || *p != '\n'));
+      }
+      if (!res.empty() && !bol)
+        res += nl;
+      return res;
+    }
+
+  }
+
+  bool Fragments::configure(v8::Local<v8::Value> list) {
+    if (!list->IsArray()) {
+      Nan::ThrowTypeError("Fragments must be an array");
+      return false;
+    }
+    v8::Local<v8::Array> arr = list.As<v8::Array>();
+    uint32_t n = arr->Length();
+    for (uint32_t i = 0; i < n; ++i) {
+      if (!node::Buffer::HasInstance(Nan::Get(arr, i).ToLocalChecked())) {
+        Nan::ThrowTypeError("Fragments must be buffers");
+        return false;
+      }
+    }
+    // Random, so that fragments can't easily contain a marker by accident.
+    // What actually guards against forged markers is the check
+    // of the tree in split.
+    std::random_device random;
+    std::ostringstream buf;
+    buf << "tidy-fragment-" << std::hex << random() << random();
+    token = buf.str();
+    input = prologue;
+    uint line = firstLine;
+    pieces.resize(n);
+    for (uint32_t i = 0; i < n; ++i) {
+      v8::Local<v8::Value> item = Nan::Get(arr, i).ToLocalChecked();
+      const char* data = node::Buffer::Data(item);
+      size_t length = node::Buffer::Length(item);
+      std::string start = "<div><!--" + Marker(token, i, false) + "-->";
+      input += start;
+      Piece& piece = pieces[i];
+      piece.offset = input.length();
+      piece.length = length;
+      piece.line = line;
+      piece.column = start.length();
+      piece.lines = LineBreaks(data, length);
+      piece.combined = false;
+      input.append(data, length);
+      input += "<!--" + Marker(token, i, true) + "--></div>\n";
+      line += piece.lines + 1;
+    }
+    input += epilogue;
+    return true;
+  }
+
+  // The markers have to survive as comments,
+  // text must not get enclosed in a container where it wouldn't be
+  // at the top level of a body of its own,
+  // and XML has no body to put the containers into.
+  bool Fragments::combinable(TidyDoc doc) const {
+    return !tidyOptGetBool(doc, TidyHideComments) &&
+      !tidyOptGetBool(doc, TidyEncloseBodyText) &&
+      !tidyOptGetBool(doc, TidyXmlTags);
+  }
+
+  void Fragments::split(TidyDoc doc, Buf& output, const Messages& messages) {
+    // The body must consist of the containers in order,
+    // each starting and ending with its own markers
+    TidyBuffer value;
+    tidyBufInitWithAllocator(&value, &allocator);
+    TidyNode body = tidyGetBody(doc);
+    TidyNode node = body ? tidyGetChild(body) : NULL;
+    bool isolated = true;
+    for (size_t i = 0; isolated && i < pieces.size(); ++i) {
+      isolated = node && tidyNodeGetId(node) == TidyTag_DIV &&
+        IsMarker(doc, tidyGetChild(node), Marker(token, i, false), &value) &&
+        IsMarker(doc, LastChild(node), Marker(token, i, true), &value);
+      if (node)
+        node = tidyGetNext(node);
+    }
+    tidyBufFree(&value);
+    if (!isolated || node) return;
+
+    TidyBuffer* out = output;
+    const char* text = out->size ? b2c(out->bp) : "";
+    const char* textEnd = text + out->size;
+    const char* nl = Newline(doc);
+    const char* pos = text;
+    std::vector<std::string> outputs(pieces.size());
+    std::vector<bool> verbatims(pieces.size());
+    for (size_t i = 0; i < pieces.size(); ++i) {
+      std::string start = "<!--" + Marker(token, i, false) + "-->";
+      std::string end = "<!--" + Marker(token, i, true) + "-->";
+      const char* s = Find(pos, textEnd, start);
+      const char* e = s ? Find(s + start.length(), textEnd, end) : NULL;
+      if (!e) return;
+      // The start marker begins the first line of the container's content,
+      // unless the printer kept that on the line of the start tag
+      const char* bol = s;
+      while (bol != text && bol[-1] == ' ')
+        --bol;
+      size_t indent = 0;
+      if (bol == text || bol[-1] == '\n' || bol[-1] == '\r')
+        indent = s - bol;
+      verbatims[i] = indent && ContainsVerbatim(s + start.length(), e);
+      outputs[i] = Unwrap(s + start.length(), e, indent, nl);
+      pos = e + end.length();
+    }
+    for (size_t i = 0; i < pieces.size(); ++i) {
+      if (verbatims[i]) continue; // needs tidying on its own
+      pieces[i].output.swap(outputs[i]);
+      pieces[i].combined = true;
+    }
+
+    // Assign every message to the fragment whose lines it refers to
+    const std::vector<int32_t>& records = messages.records;
+    for (size_t r = 0; r + 4 <= records.size(); r += 4) {
+      uint line = records[r + 1];
+      size_t lo = 0, hi = pieces.size();
+      while (lo < hi) { // first piece starting after the line
+        size_t mid = (lo + hi) / 2;
+        if (pieces[mid].line <= line) lo = mid + 1;
+        else hi = mid;
+      }
+      if (lo == 0) continue; // before the first fragment
+      Piece& piece = pieces[lo - 1];
+      if (piece.combined)
+        assign(piece, piece.line, piece.column, messages, r);
+    }
+  }
+
+  // The fragment makes up the body on its own,
+  // followed by the epilogue on its last line like the end marker,
+  // so that messages about the document are told apart the same way.
+  std::string Fragments::alone(TidyDoc doc, size_t i) const {
+    const Piece& piece = pieces[i];
+    if (!Wrapped(doc))
+      return input.substr(piece.offset, piece.length);
+    std::string res = prologue;
+    res.append(input, piece.offset, piece.length);
+    res += epilogue;
+    return res;
+  }
+
+  void Fragments::keep(TidyDoc doc, size_t i, Buf& output,
+                       const Messages& messages) {
+    TidyBuffer* out = output;
+    Piece& piece = pieces[i];
+    piece.output.assign(out->size ? b2c(out->bp) : "", out->size);
+    piece.combined = false;
+    piece.messages.records.clear();
+    piece.messages.codes.clear();
+    if (!Wrapped(doc)) {
+      piece.messages.records = messages.records;
+      piece.messages.codes = messages.codes;
+      return;
+    }
+    for (size_t r = 0; r + 4 <= messages.records.size(); r += 4)
+      assign(piece, firstLine, 0, messages, r);
+  }
+
+  void Fragments::assign(Piece& piece, uint line, uint column,
+                         const Messages& messages, size_t r) {
+    const std::vector<int32_t>& records = messages.records;
+    uint at = records[r + 1];
+    if (at < line || at > line + piece.lines) return;
+    int32_t col = records[r + 2];
+    if (at == line)
+      col = col > int32_t(column) ? col - int32_t(column) : 1;
+    add(piece.messages, records[r], at - line + 1, col,
+        messages.codes[records[r + 3]]);
+  }
+
+  void Fragments::add(Messages& to, int32_t level, int32_t line,
+                      int32_t column, const std::string& code) {
+    size_t index = std::find(to.codes.begin(), to.codes.end(), code) -
+      to.codes.begin();
+    if (index == to.codes.size())
+      to.codes.push_back(code);
+    to.records.push_back(level);
+    to.records.push_back(line);
+    to.records.push_back(column);
+    to.records.push_back(int32_t(index));
+  }
+
+  v8::Local<v8::Array> Fragments::result() const {
+    Nan::EscapableHandleScope scope;
+    v8::Local<v8::Array> res = Nan::New<v8::Array>(pieces.size());
+    for (size_t i = 0; i < pieces.size(); ++i) {
+      const Piece& piece = pieces[i];
+      v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+      Nan::Set(obj, Nan::New("output").ToLocalChecked(),
+               Nan::CopyBuffer(piece.output.data(),
+                               piece.output.length()).ToLocalChecked());
+      Nan::Set(obj, Nan::New("messages").ToLocalChecked(),
+               piece.messages.result());
+      Nan::Set(obj, Nan::New("combined").ToLocalChecked(),
+               Nan::New(piece.combined));
+      Nan::Set(res, i, obj);
+    }
+    return scope.Escape(res);
+  }
+
+}
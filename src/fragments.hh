@@ -0,0 +1,74 @@
+namespace node_libtidy {
+
+  // Many small snippets of HTML tidied as a single document,
+  // to pay for setting up a document only once instead of per snippet.
+  // Each fragment gets wrapped in a div of its own, which closes
+  // whatever the fragment left open, between two marker comments
+  // at which the output gets split again.
+  // Messages get assigned to the fragment by their line
+  // and renumbered relative to its start.
+  // Only if the tree shows that every fragment stayed in its container
+  // the split is trusted; otherwise each fragment has to be
+  // tidied on its own after all. Such a fragment still gets wrapped
+  // in the same document, just without the container,
+  // so that it reports the same messages either way.
+  class Fragments {
+  public:
+    // Reads an array of buffers; returns false after throwing
+    bool configure(v8::Local<v8::Value> list);
+
+    // Whether the options allow tidying the fragments together
+    bool combinable(TidyDoc doc) const;
+
+    // The synthetic document holding all fragments
+    const char* data() const { return input.data(); }
+    size_t length() const { return input.length(); }
+
+    size_t count() const { return pieces.size(); }
+
+    // The document for tidying fragment i on its own
+    std::string alone(TidyDoc doc, size_t i) const;
+
+    // Splits output and messages of the synthetic document.
+    // If any fragment escaped its container, none of them are split.
+    // With indentation, neither are fragments containing elements
+    // whose content tidy prints verbatim, since the indentation
+    // of the container can't be told apart from their content.
+    // May be called on a worker thread.
+    void split(TidyDoc doc, Buf& output, const Messages& messages);
+
+    // Whether fragment i got its result from the synthetic document
+    bool combined(size_t i) const { return pieces[i].combined; }
+
+    // Keeps the result of tidying fragment i on its own
+    void keep(TidyDoc doc, size_t i, Buf& output, const Messages& messages);
+
+    // [{output, messages, combined}] in the order of the input
+    v8::Local<v8::Array> result() const;
+
+  private:
+    struct Piece {
+      size_t offset; // of the fragment within input
+      size_t length;
+      uint line; // where the fragment starts in the synthetic document
+      uint column; // characters of the container before the fragment
+      uint lines; // line breaks within the fragment
+      bool combined;
+      std::string output;
+      Messages messages;
+    };
+
+    // Adds record r of the messages to the piece if it refers to the piece,
+    // given the line and column where the piece started
+    static void assign(Piece& piece, uint line, uint column,
+                       const Messages& messages, size_t r);
+
+    static void add(Messages& to, int32_t level, int32_t line,
+                    int32_t column, const std::string& code);
+
+    std::string input;
+    std::string token; // identifies the markers of this batch
+    std::vector<Piece> pieces;
+  };
+
+}
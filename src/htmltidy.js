@@ -3,6 +3,19 @@
 // Interface like htmltidy, see https://www.npmjs.com/package/htmltidy
 
 var TidyDoc = require("./TidyDoc");
+var TidyConfig = require("./TidyConfig");
+
+function finish(config, cb) {
+  return function(res) {
+    var errlog = res.errlog;
+    var output = res.output;
+    if (Buffer.isBuffer(output))
+      output = output.toString();
+    if (!config.optGet("show-warnings"))
+      errlog = "";
+    cb(errlog, output);
+  };
+}
 
 module.exports.tidy = function(text, opts, cb) {
   if (typeof cb === "undefined" && typeof opts === "function") {
@@ -12,6 +25,12 @@ module.exports.tidy = function(text, opts, cb) {
   if (typeof cb !== "function") {
     throw Error("no callback provided");
   }
+  if (!Buffer.isBuffer(text))
+    text = Buffer(String(text));
+  if (opts instanceof TidyConfig) { // use a pooled document
+    opts._tidy2(text, finish(opts, cb), cb, opts);
+    return;
+  }
   opts = opts || {};
   var doc = TidyDoc();
   doc.options = { // magic setter
@@ -21,15 +40,5 @@ module.exports.tidy = function(text, opts, cb) {
     quiet: false,
   };
   doc.options = opts; // another magic setter
-  if (!Buffer.isBuffer(text))
-    text = Buffer(String(text));
-  doc._async2(text, true, true, true, function(res) {
-    var errlog = res.errlog;
-    var output = res.output;
-    if (Buffer.isBuffer(output))
-      output = output.toString();
-    if (!doc.optGet("show-warnings"))
-      errlog = "";
-    cb(errlog, output);
-  }, cb);
+  doc._async2(text, true, true, true, finish(doc, cb), cb);
 };
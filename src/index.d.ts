@@ -4,8 +4,30 @@
 // vim: shiftwidth=2
 
 export const tidyBuffer: TidyBufferStatic
+export function tidyBufferSync(document: string | Buffer,
+  options?: Generated.OptionDict | TidyConfig): TidyResult
+export const tidyBatch: TidyBatchStatic
+export const tidyFragments: TidyFragmentsStatic
 export const TidyDoc: TidyDocConstructor
+export const TidyConfig: TidyConfigConstructor
 export const compat: TidyCompat
+export const lint: TidyLintStatic
+export function createConfig(options?: Generated.OptionDict): TidyConfig
+export function createTidyStream(options?: Generated.OptionDict | TidyConfig): TidyStream
+export function unpackMessages(messages: TidyMessages): TidyMessage[]
+export const messageLevels: string[]
+export function treeString(tree: TidyTree, index: number): string | null
+export const nodeTypes: string[]
+export const optionTable: ReadonlyArray<TidyOptionInfo>
+export function configurePool(options: PoolOptions): void
+export function poolStats(): PoolStats
+export function configureMemory(options: MemoryOptions): void
+export function memoryStats(): MemoryStats
+export function configureMetrics(options: MetricsOptions): void
+export function metricsStats(): MetricsStats
+export function configureCache(options: CacheOptions): void
+export function cacheStats(): CacheStats
+export function flushCache(): boolean
 
 /// <reference types="node" />
 import { Generated } from './options';
@@ -25,6 +47,234 @@ interface TidyResult {
    * in question, or null if no output was generated due to errors.
    */
   output?: Buffer
+  /**
+   * messages contains the diagnostics in structured form,
+   * if enabled via TidyDoc.collectMessages.
+   */
+  messages?: TidyMessages
+  /**
+   * metrics contains time and allocations of each phase of the job,
+   * for asynchroneous jobs.
+   */
+  metrics?: TidyMetrics
+  /**
+   * extracted contains the matching attribute values,
+   * for TidyDoc.extract.
+   */
+  extracted?: ExtractedValue[]
+  /**
+   * outputName is the name of the file the output was written to,
+   * or null if there was no output, for TidyDoc.tidyFile.
+   */
+  outputName?: string | null
+  /**
+   * inputHash and outputHash identify the content of input and output,
+   * for TidyDoc.tidyFile with an output file.
+   */
+  inputHash?: string
+  outputHash?: string
+  /**
+   * unchanged is true if the output file was left alone
+   * since it already held the same content, for TidyDoc.tidyFile.
+   */
+  unchanged?: boolean
+  /**
+   * skipped is true if the input matched TidyDoc.skipHash.
+   */
+  skipped?: boolean
+  /**
+   * cached is true if the result came from the result cache.
+   */
+  cached?: boolean
+}
+
+/**
+ * Elements and attributes to collect using TidyDoc.extract
+ */
+interface ExtractQuery {
+  tags?: string[]
+  attrs?: string[]
+}
+
+/**
+ * A single attribute value collected by TidyDoc.extract
+ */
+interface ExtractedValue {
+  tag: string
+  attr: string
+  value: string
+  line: number
+  column: number
+}
+
+/**
+ * Time in milliseconds, number of allocations and allocated bytes
+ */
+interface PhaseMetrics {
+  time: number
+  allocations: number
+  bytes: number
+}
+
+/**
+ * Metrics for the phases which were part of a job
+ */
+interface TidyMetrics {
+  parse?: PhaseMetrics
+  cleanAndRepair?: PhaseMetrics
+  runDiagnostics?: PhaseMetrics
+  extract?: PhaseMetrics
+  save?: PhaseMetrics
+}
+
+/**
+ * Diagnostics collected in structured form
+ */
+interface TidyMessages {
+  /** level, line, column and index into codes for each message */
+  records: Int32Array
+  codes: string[]
+}
+
+/**
+ * Settings for collecting diagnostics in structured form
+ */
+interface MessageOptions {
+  levels?: string[]
+  include?: string[]
+  exclude?: string[]
+}
+
+/**
+ * A single diagnostic message, as returned by unpackMessages
+ */
+interface TidyMessage {
+  level: string
+  line: number
+  column: number
+  code: string
+}
+
+/**
+ * Document tree in a flat layout, as returned by TidyDoc.getTree
+ */
+interface TidyTree {
+  // indexed by node number, the root being node 0
+  type: Int32Array
+  tag: Int32Array
+  parent: Int32Array
+  firstChild: Int32Array
+  nextSibling: Int32Array
+  name: Int32Array
+  value: Int32Array
+  firstAttr: Int32Array
+  attrCount: Int32Array
+  line: Int32Array
+  column: Int32Array
+  // indexed by attribute number
+  attrId: Int32Array
+  attrName: Int32Array
+  attrValue: Int32Array
+  // UTF-8 string table, string i spans stringOffsets[i] to [i + 1]
+  strings: Buffer
+  stringOffsets: Int32Array
+}
+
+/**
+ * Transform stream tidying everything written to it as one document
+ */
+interface TidyStream extends NodeJS.ReadWriteStream {
+  /** diagnostic messages, available once the stream has ended */
+  errlog: string | null
+}
+
+/**
+ * Settings for the pool of native threads running asynchroneous jobs
+ */
+interface PoolOptions {
+  /** number of threads, 0 to use the libuv threadpool instead */
+  threads?: number
+  /** maximal number of waiting jobs, 0 for no limit */
+  maxQueue?: number
+}
+
+/**
+ * State of the pool of native threads running asynchroneous jobs
+ */
+interface PoolStats {
+  threads: number
+  running: number
+  busy: number
+  queued: number
+  maxQueue: number
+  completed: number
+  rejected: number
+}
+
+/**
+ * Settings for reporting memory allocated by libtidy to V8
+ */
+interface MemoryOptions {
+  /** number of bytes to accumulate before reporting them */
+  reportThreshold?: number
+}
+
+/**
+ * Memory allocated by libtidy
+ */
+interface MemoryStats {
+  held: number
+  reported: number
+  reportThreshold: number
+}
+
+/**
+ * Settings for aggregating the metrics of all jobs
+ */
+interface MetricsOptions {
+  /** whether to aggregate the phases of all jobs */
+  histogram?: boolean
+  /** clear the data aggregated so far */
+  reset?: boolean
+}
+
+/**
+ * Phases of all jobs, aggregated by duration
+ */
+interface PhaseHistogram extends PhaseMetrics {
+  count: number
+  /** bucket i counts phases taking up to 2^i microseconds */
+  buckets: number[]
+}
+
+interface MetricsStats {
+  histogram: boolean
+  parse: PhaseHistogram
+  cleanAndRepair: PhaseHistogram
+  runDiagnostics: PhaseHistogram
+  extract: PhaseHistogram
+  save: PhaseHistogram
+}
+
+/**
+ * Settings of the result cache
+ */
+interface CacheOptions {
+  /** budget for the cached results in bytes, 0 to disable */
+  maxBytes?: number
+  /** file to load the cache from and save it to */
+  file?: string | null
+  /** drop all entries */
+  clear?: boolean
+}
+
+interface CacheStats {
+  maxBytes: number
+  bytes: number
+  entries: number
+  hits: number
+  misses: number
+  file: string | null
 }
 
 /**
@@ -42,10 +292,83 @@ interface TidyCallback {
  * turned into a buffer.
  */
 interface TidyBufferStatic {
-  (document: string | Buffer, options: Generated.OptionDict,
+  (document: string | Buffer, options: Generated.OptionDict | TidyConfig,
+    callback: TidyCallback): void
+
+  (document: string | Buffer, callback: TidyCallback): void
+}
+
+/**
+ * Callback receiving one result per input document
+ */
+interface TidyBatchCallback {
+  (err: Error | null, res: TidyResult[] | null): void
+}
+
+/**
+ * Tidy many documents using a single set of options.
+ */
+interface TidyBatchStatic {
+  (documents: (string | Buffer)[],
+    options: Generated.OptionDict | TidyConfig,
+    callback: TidyBatchCallback): void
+
+  (documents: (string | Buffer)[], callback: TidyBatchCallback): void
+
+  (documents: (string | Buffer)[],
+    options?: Generated.OptionDict | TidyConfig): Promise<TidyResult[]>
+}
+
+/**
+ * Result for one of the fragments of tidyFragments
+ */
+interface TidyFragment {
+  output: Buffer
+  /** with lines counted from the start of the fragment */
+  messages: TidyMessages
+  /** whether the fragment was tidied as part of the combined document */
+  combined: boolean
+}
+
+interface TidyFragmentsCallback {
+  (err: Error | null, res: TidyFragment[] | null): void
+}
+
+/**
+ * Tidy many pieces of HTML body as a single document.
+ */
+interface TidyFragmentsStatic {
+  (fragments: (string | Buffer)[],
+    options: Generated.OptionDict | TidyConfig,
+    callback: TidyFragmentsCallback): void
+
+  (fragments: (string | Buffer)[], callback: TidyFragmentsCallback): void
+
+  (fragments: (string | Buffer)[],
+    options?: Generated.OptionDict | TidyConfig): Promise<TidyFragment[]>
+}
+
+/**
+ * Report the problems of one or many documents without generating output.
+ */
+interface TidyLintStatic {
+  (document: string | Buffer,
+    options: Generated.OptionDict | TidyConfig,
     callback: TidyCallback): void
 
   (document: string | Buffer, callback: TidyCallback): void
+
+  (document: string | Buffer,
+    options?: Generated.OptionDict | TidyConfig): Promise<TidyResult>
+
+  (documents: (string | Buffer)[],
+    options: Generated.OptionDict | TidyConfig,
+    callback: TidyBatchCallback): void
+
+  (documents: (string | Buffer)[], callback: TidyBatchCallback): void
+
+  (documents: (string | Buffer)[],
+    options?: Generated.OptionDict | TidyConfig): Promise<TidyResult[]>
 }
 
 export class TidyOption {
@@ -60,6 +383,30 @@ export class TidyOption {
   toString(): string
 }
 
+/**
+ * Everything a TidyOption tells about itself, in a plain frozen object
+ */
+interface TidyOptionInfo {
+  readonly id: number
+  readonly name: string
+  // name as used for the keys of TidyDoc.options
+  readonly key: string
+  readonly category: string
+  readonly type: "boolean" | "integer" | "string"
+  readonly default: boolean | number | string | null
+  readonly readOnly: boolean
+  readonly pickList: ReadonlyArray<string>
+}
+
+/**
+ * The part of an AbortSignal used to abort jobs
+ */
+interface AbortSignalLike {
+  readonly aborted: boolean
+  addEventListener(type: "abort", listener: () => void): void
+  removeEventListener(type: "abort", listener: () => void): void
+}
+
 type TidyOptionKey = TidyOption | string | number // object or name or id
 type TidyOptionValue = boolean | number | string | null
 
@@ -76,17 +423,57 @@ interface TidyDoc {
   parseBufferSync(document: Buffer): string
   runDiagnosticsSync(): string
   saveBufferSync(): Buffer
+  collectMessages(options: boolean | MessageOptions): void
+  getMessages(): TidyMessages | null
+  getTree(): TidyTree
   // getErrorLog(): string // is not needed: other calls already return log
 
   // Async calls
   cleanAndRepair(callback: TidyCallback): void
   parseBuffer(document: Buffer, callback: TidyCallback): void
+  parseStream(stream: NodeJS.ReadableStream, callback: TidyCallback): void
+  parseStream(stream: NodeJS.ReadableStream): Promise<TidyResult>
   runDiagnostics(callback: TidyCallback): void
   saveBuffer(callback: TidyCallback): void
+  saveStream(stream: NodeJS.WritableStream, callback: TidyCallback): void
+  saveStream(stream: NodeJS.WritableStream): Promise<TidyResult>
   tidyBuffer(buf: Buffer, callback: TidyCallback): void
+  tidyBufferSync(buf: Buffer): TidyResult
+  tidyBatch(bufs: Buffer[], callback: TidyBatchCallback): void
+  tidyBatch(bufs: Buffer[]): Promise<TidyResult[]>
+  tidyFragments(bufs: Buffer[], callback: TidyFragmentsCallback): void
+  tidyFragments(bufs: Buffer[]): Promise<TidyFragment[]>
+  tidyFile(input: string, output: string, callback: TidyCallback): void
+  tidyFile(input: string, callback: TidyCallback): void
+  tidyFile(input: string, output?: string): Promise<TidyResult>
+  extract(buf: Buffer | null, query: ExtractQuery,
+    callback: TidyCallback): void
+  extract(buf: Buffer | null, query: ExtractQuery): Promise<TidyResult>
+  lint(buf: Buffer, callback: TidyCallback): void
+  lint(buf: Buffer): Promise<TidyResult>
+  lintBatch(bufs: Buffer[], callback: TidyBatchCallback): void
+  lintBatch(bufs: Buffer[]): Promise<TidyResult[]>
+
+  // Jobs with higher priority leave the pool queue first
+  priority: number
+  // Milliseconds a job may run before it gets rejected, 0 for no limit
+  timeout: number
+  // Bytes the document may hold before a job gets rejected, 0 for no limit
+  memoryLimit: number
+  // Whether tidyBuffer may be answered from the result cache
+  cache: boolean
+  // Aborts the running job once it fires
+  signal: AbortSignalLike | null
+  // Input file hash for which tidyFile skips the job
+  skipHash: string | null
+  abort(): boolean
 
   // batch set/get of options
   options: Generated.OptionDict
+  getOptions(changedOnly?: boolean): Generated.OptionDict
+  setOptions(options: Generated.OptionDict): void
+  optionsHash(): string
+  applyConfig(config: TidyConfig): void
   // Methods that return TidyOption object
   getOptionList(): TidyOption[]
   getOption(key: TidyOptionKey): TidyOption
@@ -104,8 +491,49 @@ interface TidyDoc {
  * (Can be used with `new` or normal call)
  */
 interface TidyDocConstructor {
-  new (): TidyDoc
-  (): TidyDoc
+  new (options?: TidyDocOptions): TidyDoc
+  (options?: TidyDocOptions): TidyDoc
+}
+
+/**
+ * Options resolved and validated once, to be applied to many documents
+ */
+interface TidyConfig {
+  optGet(key: TidyOptionKey): TidyOptionValue
+  getOptions(changedOnly?: boolean): Generated.OptionDict
+  tidyBuffer(buf: Buffer, callback: TidyCallback): void
+  tidyBuffer(buf: Buffer): Promise<TidyResult>
+  tidyBufferSync(buf: Buffer): TidyResult
+
+  // Jobs with higher priority leave the pool queue first
+  priority: number
+  // Milliseconds a job may run before it gets rejected, 0 for no limit
+  timeout: number
+  // Bytes the document may hold before a job gets rejected, 0 for no limit
+  memoryLimit: number
+  // Whether jobs may be answered from the result cache
+  cache: boolean
+  // Maximal number of idle documents kept for reuse
+  poolSize: number
+  // Number of idle documents kept for reuse right now
+  readonly idle: number
+}
+
+/**
+ * Constructor
+ * (Can be used with `new` or normal call)
+ */
+interface TidyConfigConstructor {
+  new (options?: Generated.OptionDict): TidyConfig
+  (options?: Generated.OptionDict): TidyConfig
+}
+
+/**
+ * Settings which have to be chosen when a TidyDoc gets created
+ */
+interface TidyDocOptions {
+  /** allocate from an arena which gets released as a whole */
+  arena?: boolean
 }
 
 /**
@@ -1,6 +1,9 @@
 "use strict";
 
+const EventEmitter = require("events");
 const fs = require("fs");
+const os = require("os");
+const path = require("path");
 
 var lib = require("./lib");
 for (let key in lib)
@@ -9,34 +12,147 @@ for (let key in lib)
 module.exports.nodeModuleVersion = require("../package.json").version;
 
 var TidyDoc = require("./TidyDoc");
+var TidyConfig = require("./TidyConfig");
+var TidyStream = require("./TidyStream");
+var Manifest = require("./manifest");
 
 module.exports.compat = require("./compat");
 
 class TidyException extends Error {
   constructor(message, opts) {
-    this.message = message;
+    super(message);
     for (var key in opts)
       this[key] = opts[key];
     Error.captureStackTrace(this, TidyException);
   }
 }
 
+// Options for the high-level functions may be a dictionary,
+// which gets applied on top of the defaults,
+// or a TidyConfig, which replaces all options in one go.
+function newDoc(opts) {
+  var doc = TidyDoc();
+  doc.cache = true; // nobody gets to see the document afterwards
+  if (opts instanceof TidyConfig) {
+    doc.applyConfig(opts);
+  } else {
+    doc.options = {
+      newline: "LF",
+    };
+    doc.options = opts || {};
+  }
+  return doc;
+}
+
+// Save the result cache when the process exits,
+// once there is a file to save it to.
+// The cache is merely an optimization, so failing to save it
+// must not turn the exit into a crash.
+var flushOnExit = false;
+
+function configureCache(opts) {
+  lib.configureCache(opts);
+  if (!flushOnExit && lib.cacheStats().file !== null) {
+    process.once("exit", () => {
+      try {
+        lib.flushCache();
+      } catch (err) {
+        // ignore
+      }
+    });
+    flushOnExit = true;
+  }
+}
+
+function createConfig(opts) {
+  return new TidyConfig(Object.assign({newline: "LF"}, opts));
+}
+
 function tidyBuffer(buf, opts, cb) {
   if (typeof cb === "undefined" && typeof opts === "function") {
     cb = opts;
     opts = {};
   }
-  opts = opts || {};
-  var doc = TidyDoc();
-  doc.options = {
-    newline: "LF",
-  };
-  doc.options = opts;
   if (!Buffer.isBuffer(buf))
     buf = Buffer(String(buf));
+  if (opts instanceof TidyConfig)
+    return opts.tidyBuffer(buf, cb); // uses a pooled document
+  var doc = newDoc(opts);
   return doc.tidyBuffer(buf, cb); // can handle both cb and promise
 }
 
+// For small documents, where a trip to the worker pool
+// would take longer than tidying them right away
+function tidyBufferSync(buf, opts) {
+  if (!Buffer.isBuffer(buf))
+    buf = Buffer(String(buf));
+  if (opts instanceof TidyConfig)
+    return opts.tidyBufferSync(buf); // uses a pooled document
+  return newDoc(opts).tidyBufferSync(buf);
+}
+
+function tidyBatch(bufs, opts, cb) {
+  if (typeof cb === "undefined" && typeof opts === "function") {
+    cb = opts;
+    opts = {};
+  }
+  var doc = newDoc(opts);
+  bufs = Array.from(bufs, buf => Buffer.isBuffer(buf) ? buf : Buffer(String(buf)));
+  return doc.tidyBatch(bufs, cb); // can handle both cb and promise
+}
+
+// Many small pieces of a body, tidied as a single document if possible
+function tidyFragments(bufs, opts, cb) {
+  if (typeof cb === "undefined" && typeof opts === "function") {
+    cb = opts;
+    opts = {};
+  }
+  var doc = newDoc(opts);
+  bufs = Array.from(bufs, buf => Buffer.isBuffer(buf) ? buf : Buffer(String(buf)));
+  return doc.tidyFragments(bufs, cb);
+}
+
+// Only diagnostics: the output is never generated,
+// and messages get collected as records instead of the text log.
+// Takes a single input or an array of them.
+function lint(input, opts, cb) {
+  if (typeof cb === "undefined" && typeof opts === "function") {
+    cb = opts;
+    opts = {};
+  }
+  var toBuffer = buf => Buffer.isBuffer(buf) ? buf : Buffer(String(buf));
+  var doc = newDoc(opts);
+  doc.collectMessages(true);
+  if (Array.isArray(input))
+    return doc.lintBatch(input.map(toBuffer), cb);
+  return doc.lint(toBuffer(input), cb);
+}
+
+function createTidyStream(opts) {
+  return new TidyStream(newDoc(opts));
+}
+
+function unpackMessages(messages) {
+  var records = messages.records, codes = messages.codes;
+  var list = new Array(records.length >> 2);
+  for (var i = 0, j = 0; i < list.length; ++i, j += 4) {
+    list[i] = {
+      level: lib.messageLevels[records[j]],
+      line: records[j + 1],
+      column: records[j + 2],
+      code: codes[records[j + 3]],
+    };
+  }
+  return list;
+}
+
+// Strings of a tree obtained from TidyDoc.getTree are only decoded on demand
+function treeString(tree, index) {
+  if (index < 0) return null;
+  var offsets = tree.stringOffsets;
+  return tree.strings.toString("utf-8", offsets[index], offsets[index + 1]);
+}
+
 function readFile(name) {
   return new Promise((resolve, reject) =>
     fs.readFile(name, (err, content) => {
@@ -50,8 +166,8 @@ function readStream(stream, name) {
   return new Promise((resolve, reject) => {
     const chunks = [];
     stream.once("error", reject);
-    stream.on("data", chunk => chunks.append(chunk));
-    stream.on("end", resolve({name: name, buf: Buffer.concat(chunks)}));
+    stream.on("data", chunk => chunks.push(chunk));
+    stream.on("end", () => resolve({name: name, buf: Buffer.concat(chunks)}));
   });
 }
 
@@ -135,19 +251,247 @@ function tidyFileToFile(input, output, opts, cb) {
     }
   }
   return promiseOrCallback(cb, () =>
-    readFile(input).then(tidyUp(opts)).then(writeFile(output)));
+    newDoc(opts).tidyFile(input, output).then(res => {
+      if (!res.outputName)
+        throw new TidyException(`Failed to parse ${input}`, res);
+      res.inputName = input;
+      return res;
+    }));
 };
 
-function tidyFilesInPlace(files, opts, cb) {
+// Like tidyBuffer, but the input file never gets copied into a buffer
+function tidyFile(input, opts, cb) {
   if (typeof cb === "undefined" && typeof opts === "function") {
     cb = opts;
     opts = {};
   }
   return promiseOrCallback(cb, () =>
-    Promise.all(Array.from(files, file => tidyFileToFile(file, file, opts))));
+    newDoc(opts).tidyFile(input).then(res => {
+      if (!res.output)
+        throw new TidyException(`Failed to parse ${input}`, res);
+      res.inputName = input;
+      return res;
+    }));
+}
+
+// Tidy many files with a bounded number of jobs at a time,
+// so that only that many documents are held in memory.
+// Each lane of the queue reuses a single document.
+// Output files get replaced atomically, and a file tidied in place
+// is left alone if its output is the same as its input.
+// The optional settings may contain the following:
+//   output - maps the name of an input file to its output file,
+//            defaults to writing each file in place
+//   concurrency - number of lanes, defaults to the size of the worker pool
+//   messages - if set, passed to collectMessages of each document
+//   manifest - name of a file recording earlier runs,
+//              so that files which are known to be tidy get skipped
+//   onFile - called as onFile(err, res, index) once each file is done,
+//            may return false to stop starting further files.
+//            Without it, the queue rejects with the first error.
+// Resolves once all started files are done.
+function tidyFileQueue(files, opts, settings) {
+  settings = settings || {};
+  var manifest = settings.manifest;
+  if (typeof manifest !== "string")
+    return runFileQueue(files, opts, settings, manifest || null);
+  return Manifest.load(manifest).then(manifest =>
+    runFileQueue(files, opts, settings, manifest).then(
+      () => manifest.save(),
+      err => manifest.save().then(() => { throw err; })));
+}
+
+function runFileQueue(files, opts, settings, manifest) {
+  files = Array.from(files);
+  var output = settings.output || (name => name);
+  var onFile = settings.onFile || (err => {
+    if (err) throw err;
+  });
+  var concurrency = settings.concurrency ||
+      lib.poolStats().threads || os.cpus().length;
+  var options = null;
+  var next = 0;
+  var stopped = false;
+  function tidyOne(doc, input) {
+    var out = output(input);
+    if (!manifest)
+      return doc.tidyFile(input, out);
+    var plan;
+    return manifest.check(input, out, options).then(p => {
+      plan = p;
+      if (plan.skip)
+        return {outputName: out, skipped: true};
+      doc.skipHash = plan.skipHash;
+      return doc.tidyFile(input, out);
+    }).then(res => {
+      if (!res.outputName || plan.skip) return res;
+      return manifest.record(input, out, options, plan, res).then(() => res);
+    }, err => {
+      manifest.forget(input);
+      throw err;
+    });
+  }
+  function lane(doc) {
+    if (stopped || next === files.length)
+      return Promise.resolve();
+    var index = next++;
+    var input = files[index];
+    return tidyOne(doc, input).then(res => {
+      if (!res.outputName) {
+        if (manifest) manifest.forget(input);
+        throw new TidyException(`Failed to parse ${input}`, res);
+      }
+      res.inputName = input;
+      return res;
+    }).then(
+      res => onFile(null, res, index),
+      err => onFile(err, null, index)
+    ).then(proceed => {
+      if (proceed === false) stopped = true;
+      return lane(doc);
+    });
+  }
+  var lanes = [];
+  for (var i = 0; i < concurrency && i < files.length; ++i) {
+    var doc = newDoc(opts);
+    if (settings.messages)
+      doc.collectMessages(settings.messages);
+    if (options === null)
+      options = doc.optionsHash();
+    lanes.push(lane(doc));
+  }
+  return Promise.all(lanes);
+}
+
+// Tidy the files once, like tidyFileQueue with the same settings,
+// then keep watching them and tidy each file again once it changed.
+// Changes arriving within settings.delay milliseconds (default 100)
+// get tidied together. Files whose output went unchanged
+// are not written, so writing in place doesn't start an endless loop.
+// Returns an event emitter with a close method to stop watching,
+// which emits "error" if watching fails and "idle" after each round.
+// Without settings.onFile, files which fail get reported as "error" too.
+function watchFiles(files, opts, settings) {
+  settings = settings || {};
+  files = Array.from(files);
+  var watcher = new EventEmitter();
+  var manifest = null;
+  var watched = new Set(files.map(name => path.resolve(name)));
+  var byDir = new Map();
+  for (var name of files) {
+    var dir = path.dirname(path.resolve(name));
+    if (!byDir.has(dir)) byDir.set(dir, []);
+    byDir.get(dir).push(name);
+  }
+  var handles = [];
+  var changed = new Set();
+  var timer = null;
+  var running = null;
+  var closed = false;
+  var onFile = settings.onFile || (err => {
+    if (err && !closed) watcher.emit("error", err);
+  });
+  function run(batch) { // indices into files
+    var names = batch.map(index => files[index]);
+    var roundSettings = Object.assign({}, settings, {
+      onFile: (err, res, index) => onFile(err, res, batch[index]),
+    });
+    running = runFileQueue(names, opts, roundSettings, manifest)
+      .then(() => manifest && manifest.save())
+      .then(() => {
+        running = null;
+        if (!closed) watcher.emit("idle");
+        if (changed.size) schedule();
+      }, err => {
+        running = null;
+        if (!closed) watcher.emit("error", err);
+      });
+  }
+  function schedule() {
+    if (timer || closed) return;
+    timer = setTimeout(() => {
+      timer = null;
+      if (running) return; // picked up once the current round is done
+      var batch = [];
+      files.forEach((name, index) => {
+        if (changed.has(path.resolve(name))) batch.push(index);
+      });
+      changed.clear();
+      if (batch.length) run(batch);
+    }, settings.delay || 100);
+  }
+  function onChange(dir, filename) {
+    if (!filename) { // the platform won't say which, so check all of them
+      byDir.get(dir).forEach(name => changed.add(path.resolve(name)));
+    } else {
+      var name = path.join(dir, String(filename));
+      if (!watched.has(name)) return;
+      changed.add(name);
+    }
+    schedule();
+  }
+  watcher.close = function() {
+    closed = true;
+    clearTimeout(timer);
+    handles.forEach(handle => handle.close());
+    return running || Promise.resolve();
+  };
+  var ready = typeof settings.manifest === "string" ?
+      Manifest.load(settings.manifest) : Promise.resolve(null);
+  ready.then(m => {
+    manifest = m;
+    if (closed) return;
+    byDir.forEach((names, dir) => {
+      var handle = fs.watch(dir, (event, filename) => onChange(dir, filename));
+      handle.on("error", err => watcher.emit("error", err));
+      handles.push(handle);
+    });
+    run(files.map((name, index) => index));
+  }, err => watcher.emit("error", err));
+  return watcher;
+}
+
+// The settings may name a manifest, as for tidyFileQueue
+function tidyFilesInPlace(files, opts, settings, cb) {
+  if (typeof opts === "function") {
+    cb = opts;
+    opts = {};
+    settings = {};
+  } else if (typeof settings === "function") {
+    cb = settings;
+    settings = {};
+  }
+  settings = settings || {};
+  return promiseOrCallback(cb, () => {
+    var results = [];
+    var error = null;
+    return tidyFileQueue(files, opts, {
+      manifest: settings.manifest,
+      onFile: (err, res, index) => {
+        if (!err) {
+          results[index] = res;
+          return true;
+        }
+        if (!error) error = err;
+        return false;
+      },
+    }).then(() => {
+      if (error) throw error;
+      return results;
+    });
+  });
 }
 
 module.exports.tidyBuffer = tidyBuffer;
+module.exports.tidyBufferSync = tidyBufferSync;
+module.exports.tidyBatch = tidyBatch;
+module.exports.tidyFragments = tidyFragments;
+module.exports.lint = lint;
+module.exports.createTidyStream = createTidyStream;
+module.exports.configureCache = configureCache;
+module.exports.createConfig = createConfig;
+module.exports.unpackMessages = unpackMessages;
+module.exports.treeString = treeString;
 module.exports.readFile = readFile;
 module.exports.readStream = readStream;
 module.exports.readStdin = readStdin;
@@ -159,4 +503,7 @@ module.exports.writeStreamChecked = writeStreamChecked;
 module.exports.writeStdout = writeStdout;
 module.exports.promiseOrCallback = promiseOrCallback;
 module.exports.tidyFileToFile = tidyFileToFile;
+module.exports.tidyFile = tidyFile;
+module.exports.tidyFileQueue = tidyFileQueue;
 module.exports.tidyFilesInPlace = tidyFilesInPlace;
+module.exports.watchFiles = watchFiles;
@@ -0,0 +1,67 @@
+#include "node-libtidy.hh"
+
+namespace node_libtidy {
+
+  namespace {
+
+    uv_once_t once = UV_ONCE_INIT;
+    Nan::nauv_key_t key;
+
+    void CreateKey() {
+      Nan::nauv_key_create(&key);
+    }
+
+  }
+
+  // Must come first, since the other modules keep their state here.
+  // Loading the addon into another context of the same isolate
+  // finds the instance already there.
+  NAN_MODULE_INIT(Instance::Init) {
+    uv_once(&once, CreateKey);
+    if (Current()) return;
+    Instance* self = new Instance();
+    Nan::nauv_key_set(&key, self);
+#if NODE_MAJOR_VERSION > 10 || \
+    (NODE_MAJOR_VERSION == 10 && NODE_MINOR_VERSION >= 2)
+    node::AddEnvironmentCleanupHook(v8::Isolate::GetCurrent(), Cleanup, self);
+#endif
+  }
+
+  Instance* Instance::Current() {
+    return static_cast<Instance*>(Nan::nauv_key_get(&key));
+  }
+
+  v8::Local<v8::FunctionTemplate>
+  Instance::Keep(Nan::Persistent<v8::FunctionTemplate>& slot,
+                 v8::Local<v8::FunctionTemplate> tpl) {
+    if (slot.IsEmpty())
+      slot.Reset(tpl);
+    return Nan::New(slot);
+  }
+
+  Instance::Instance()
+    : loop(Nan::GetCurrentEventLoop()), reportedMem(0), pendingMem(0),
+      reportThreshold(64 * 1024), poolAsync(NULL), poolOutstanding(0)
+  {
+  }
+
+  Instance::~Instance() {
+    docTemplate.Reset();
+    optTemplate.Reset();
+    configTemplate.Reset();
+    inputStreamTemplate.Reset();
+    outputStreamTemplate.Reset();
+  }
+
+  // Jobs still pending for the isolate get dropped,
+  // while memory released after this point is no longer reported.
+  // The slot gets cleared before the instance goes away,
+  // so that adjustMem can't find it half destroyed.
+  void Instance::Cleanup(void* arg) {
+    Instance* self = static_cast<Instance*>(arg);
+    Pool::Detach(self);
+    Nan::nauv_key_set(&key, NULL);
+    delete self;
+  }
+
+}
@@ -0,0 +1,54 @@
+namespace node_libtidy {
+
+  class TidyWorker;
+
+  // State of the addon which belongs to a single isolate,
+  // i.e. to the main thread or to one of the worker_threads.
+  // The addon gets initialized once by every thread loading it,
+  // and each of these threads finds its own instance
+  // in a thread-local slot. Threads of the tidy pool have none.
+  // Unless noted otherwise, members are only accessed by that thread.
+  class Instance {
+  public:
+    static NAN_MODULE_INIT(Init);
+
+    // Instance of the calling thread, or NULL if there is none
+    static Instance* Current();
+
+    // Stores the template in the slot unless another context
+    // of the isolate loaded the addon before, and returns the stored one
+    static v8::Local<v8::FunctionTemplate>
+    Keep(Nan::Persistent<v8::FunctionTemplate>& slot,
+         v8::Local<v8::FunctionTemplate> tpl);
+
+    uv_loop_t* loop;
+
+    // Templates of the wrapped classes
+    Nan::Persistent<v8::FunctionTemplate> docTemplate;
+    Nan::Persistent<v8::FunctionTemplate> optTemplate;
+    Nan::Persistent<v8::FunctionTemplate> configTemplate;
+    Nan::Persistent<v8::FunctionTemplate> inputStreamTemplate;
+    Nan::Persistent<v8::FunctionTemplate> outputStreamTemplate;
+
+    // Memory reported to this isolate, see adjustMem.
+    // Telling V8 about every single allocation would be costly,
+    // so changes only get reported once they add up to the threshold.
+    double reportedMem;
+    ssize_t pendingMem;
+    ssize_t reportThreshold;
+
+    // Delivery of the jobs the pool finished for this isolate.
+    // The vector is protected by the mutex of the pool.
+    uv_async_t* poolAsync;
+    std::vector<TidyWorker*> poolDone;
+    unsigned poolOutstanding;
+
+  private:
+    Instance();
+    ~Instance();
+
+    // Runs when the environment of the thread gets torn down
+    static void Cleanup(void* arg);
+  };
+
+}
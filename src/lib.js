@@ -1,4 +1,11 @@
 "use strict";
 
-module.exports = require(
+var lib = module.exports = require(
   require("node-pre-gyp").find(require.resolve("../package.json")));
+
+// Option metadata is built once natively and shared by everyone
+lib.optionTable.forEach(function(opt) {
+  Object.freeze(opt.pickList);
+  Object.freeze(opt);
+});
+Object.freeze(lib.optionTable);
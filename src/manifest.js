@@ -0,0 +1,136 @@
+"use strict";
+
+const fs = require("fs");
+const path = require("path");
+
+var lib = require("./lib");
+
+const VERSION = 1;
+
+function stat(name) {
+  return new Promise(resolve =>
+    fs.stat(name, (err, st) => resolve(err ? null : st)));
+}
+
+function sameStat(entry, prefix, st) {
+  return st !== null &&
+    entry[prefix + "Size"] === st.size &&
+    entry[prefix + "Mtime"] === st.mtime.getTime();
+}
+
+// Record of earlier runs of tidyFileQueue, kept in a JSON file.
+// For each input file it stores the hashes of the input,
+// of the options and of the output, as reported by the native jobs,
+// together with size and modification time of input and output file,
+// so that later runs only tidy those files which might have changed.
+// The whole manifest gets discarded if libtidy changed in between.
+class Manifest {
+
+  constructor(file) {
+    this.file = file;
+    this.files = Object.create(null);
+  }
+
+  // Resolves to the manifest stored in the file,
+  // or to an empty one if there is no such file yet
+  static load(file) {
+    var manifest = new Manifest(file);
+    return new Promise((resolve, reject) =>
+      fs.readFile(file, "utf8", (err, content) => {
+        if (err && err.code !== "ENOENT") return reject(err);
+        var data = null;
+        try {
+          if (!err) data = JSON.parse(content);
+        } catch (e) {
+          // start over
+        }
+        if (data && data.version === VERSION &&
+            data.libraryVersion === lib.libraryVersion &&
+            data.files && typeof data.files === "object") {
+          for (var key in data.files)
+            manifest.files[key] = data.files[key];
+        }
+        resolve(manifest);
+      }));
+  }
+
+  // Resolves to what needs to be done about the input file:
+  //   skip - true if the file is known to need no tidying
+  //   skipHash - otherwise, the hash of an input file which needs none
+  //   stat - of the input file, before tidying it
+  // A file tidied in place only counts as tidy
+  // once tidying it left it unchanged.
+  check(input, output, options) {
+    var entry = this.files[path.resolve(input)];
+    var inPlace = path.resolve(output) === path.resolve(input);
+    return stat(input).then(st => {
+      var res = {skip: false, skipHash: null, stat: st};
+      if (!entry || entry.options !== options ||
+          entry.target !== path.resolve(output))
+        return res;
+      if (inPlace) {
+        if (entry.input !== entry.output) return res;
+        res.skip = sameStat(entry, "input", st);
+        res.skipHash = entry.input;
+        return res;
+      }
+      return stat(output).then(outSt => {
+        if (!sameStat(entry, "output", outSt)) return res;
+        res.skip = sameStat(entry, "input", st);
+        res.skipHash = entry.input;
+        return res;
+      });
+    });
+  }
+
+  // Remembers the result of a successful job
+  record(input, output, options, plan, res) {
+    var key = path.resolve(input);
+    var old = this.files[key];
+    var entry = {
+      options: options,
+      target: path.resolve(output),
+      input: res.inputHash,
+      output: res.outputHash,
+    };
+    if (res.skipped) // the input is the one recorded before
+      entry.output = key === entry.target ? entry.input : old.output;
+    if (plan.stat) {
+      entry.inputSize = plan.stat.size;
+      entry.inputMtime = plan.stat.mtime.getTime();
+    }
+    this.files[key] = entry;
+    return stat(output).then(st => {
+      if (st) {
+        entry.outputSize = st.size;
+        entry.outputMtime = st.mtime.getTime();
+      }
+    });
+  }
+
+  forget(input) {
+    delete this.files[path.resolve(input)];
+  }
+
+  // Writes the manifest to a temporary file which then replaces it,
+  // so that an interrupted run never leaves a truncated manifest behind
+  save() {
+    var data = JSON.stringify({
+      version: VERSION,
+      libraryVersion: lib.libraryVersion,
+      files: this.files,
+    }, null, 1);
+    var temp = this.file + ".tmp-" + process.pid;
+    return new Promise((resolve, reject) =>
+      fs.writeFile(temp, data, err => {
+        if (err) return reject(err);
+        fs.rename(temp, this.file, err => {
+          if (err) reject(err);
+          else resolve();
+        });
+      }));
+  }
+
+}
+
+module.exports = Manifest;
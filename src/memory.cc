@@ -2,6 +2,7 @@
 
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 
 namespace node_libtidy {
 
@@ -58,21 +59,232 @@ namespace node_libtidy {
       std::abort();
     }
 
-    const TidyAllocatorVtbl vtbl = {
+    const TidyAllocatorVtbl heapVtbl = {
       myAlloc,
       myRealloc,
       myFree,
       myPanic
     };
 
+    uv_once_t tlsOnce = UV_ONCE_INIT;
     Nan::nauv_key_t tlsKey;
 
+    void CreateKey() {
+      Nan::nauv_key_create(&tlsKey);
+    }
+
+    // Size of regular arena chunks.
+    // Larger blocks get a chunk of their own.
+    const size_t chunkSize = 64 * 1024;
+
+    inline size_t align(size_t size) {
+      const size_t a = hdrSize();
+      return (size + a - 1) / a * a;
+    }
+
   }
 
   TidyAllocator allocator = {
-    &vtbl
+    &heapVtbl
+  };
+
+  struct DocAllocator::Chunk {
+    Chunk* next;
+    size_t size; // usable bytes
+    size_t used;
+    double data;
+  };
+
+  const TidyAllocatorVtbl DocAllocator::docHeapVtbl = {
+    heapAlloc,
+    heapRealloc,
+    heapFree,
+    myPanic
+  };
+
+  const TidyAllocatorVtbl DocAllocator::arenaVtbl = {
+    arenaAlloc,
+    arenaRealloc,
+    arenaFree,
+    myPanic
   };
 
+  DocAllocator::DocAllocator(bool arena)
+    : chunks(NULL), lastChunk(NULL), last(NULL),
+      bytes(0), limit(0), exceeded(false), allocCount(0), allocBytes(0)
+  {
+    TidyAllocator::vtbl = arena ? &arenaVtbl : &docHeapVtbl;
+  }
+
+  DocAllocator::~DocAllocator() {
+    release(detach());
+  }
+
+  bool DocAllocator::isArena() const {
+    return TidyAllocator::vtbl == &arenaVtbl;
+  }
+
+  void DocAllocator::setLimit(size_t limit) {
+    this->limit = limit;
+    exceeded.store(false, std::memory_order_relaxed);
+  }
+
+  void DocAllocator::account(ssize_t diff) {
+    bytes += diff;
+    if (limit && bytes > limit)
+      exceeded.store(true, std::memory_order_relaxed);
+  }
+
+  DocAllocator::Chunk* DocAllocator::detach() {
+    Chunk* res = chunks;
+    chunks = lastChunk = NULL;
+    last = NULL;
+    if (isArena())
+      bytes = 0;
+    return res;
+  }
+
+  void DocAllocator::release(Chunk* chunks) {
+    while (chunks) {
+      Chunk* next = chunks->next;
+      adjustMem(-ssize_t(chunks->size + offsetof(Chunk, data)));
+      std::free(chunks);
+      chunks = next;
+    }
+  }
+
+  DocAllocator::Chunk* DocAllocator::newChunk(size_t size) {
+    size_t totalSize = size + offsetof(Chunk, data);
+    Chunk* chunk = static_cast<Chunk*>(std::malloc(totalSize));
+    if (!chunk) return NULL;
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    adjustMem(totalSize);
+    return chunk;
+  }
+
+  void* TIDY_CALL DocAllocator::heapAlloc(TidyAllocator* base, size_t size) {
+    static_cast<DocAllocator*>(base)->count(size);
+    void* res = myAlloc(base, size);
+    if (res)
+      static_cast<DocAllocator*>(base)->account(size + hdrSize());
+    return res;
+  }
+
+  void* TIDY_CALL DocAllocator::heapRealloc(TidyAllocator* base,
+                                            void* buf, size_t size) {
+    static_cast<DocAllocator*>(base)->count(size);
+    ssize_t oldSize = buf ? ssize_t(client2hdr(buf)->size + hdrSize()) : 0;
+    void* res = myRealloc(base, buf, size);
+    if (res)
+      static_cast<DocAllocator*>(base)->account
+        (ssize_t(size + hdrSize()) - oldSize);
+    return res;
+  }
+
+  void TIDY_CALL DocAllocator::heapFree(TidyAllocator* base, void* buf) {
+    if (!buf) return;
+    static_cast<DocAllocator*>(base)->account
+      (-ssize_t(client2hdr(buf)->size + hdrSize()));
+    myFree(base, buf);
+  }
+
+  void* TIDY_CALL DocAllocator::arenaAlloc(TidyAllocator* base, size_t size) {
+    DocAllocator* self = static_cast<DocAllocator*>(base);
+    self->count(size);
+    size_t need = align(size + hdrSize());
+    Chunk* chunk = self->chunks;
+    if (!chunk || chunk->size - chunk->used < need) {
+      if (need > chunkSize / 4) {
+        // Keep the current chunk for subsequent small allocations
+        chunk = newChunk(need);
+        if (!chunk) return NULL;
+        self->account(chunk->size + offsetof(Chunk, data));
+        if (self->chunks) {
+          chunk->next = self->chunks->next;
+          self->chunks->next = chunk;
+        } else {
+          self->chunks = chunk;
+        }
+      } else {
+        chunk = newChunk(chunkSize);
+        if (!chunk) return NULL;
+        self->account(chunk->size + offsetof(Chunk, data));
+        chunk->next = self->chunks;
+        self->chunks = chunk;
+      }
+    }
+    memHdr* mem = reinterpret_cast<memHdr*>
+      (reinterpret_cast<char*>(&chunk->data) + chunk->used);
+    chunk->used += need;
+    mem->size = need - hdrSize();
+    self->lastChunk = chunk;
+    self->last = hdr2client(mem);
+    return self->last;
+  }
+
+  void* TIDY_CALL DocAllocator::arenaRealloc(TidyAllocator* base,
+                                             void* buf, size_t size) {
+    if (!buf) return arenaAlloc(base, size);
+    DocAllocator* self = static_cast<DocAllocator*>(base);
+    memHdr* mem = client2hdr(buf);
+    if (size <= mem->size) {
+      self->count(size);
+      return buf;
+    }
+    if (buf == self->last) {
+      Chunk* chunk = self->lastChunk;
+      size_t grow = align(size + hdrSize()) - (mem->size + hdrSize());
+      if (chunk->size - chunk->used >= grow) {
+        self->count(size);
+        chunk->used += grow;
+        mem->size += grow;
+        return buf;
+      }
+    }
+    void* res = arenaAlloc(base, size);
+    if (!res) return NULL;
+    std::memcpy(res, buf, mem->size);
+    return res;
+  }
+
+  void TIDY_CALL DocAllocator::arenaFree(TidyAllocator*, void*) {
+    // memory gets reclaimed when the whole arena is released
+  }
+
+  const TidyAllocatorVtbl CountingAllocator::countingVtbl = {
+    countAlloc,
+    countRealloc,
+    countFree,
+    myPanic
+  };
+
+  CountingAllocator::CountingAllocator() : allocCount(0), allocBytes(0) {
+    TidyAllocator::vtbl = &countingVtbl;
+  }
+
+  void* TIDY_CALL CountingAllocator::countAlloc(TidyAllocator* base,
+                                                size_t size) {
+    CountingAllocator* self = static_cast<CountingAllocator*>(base);
+    ++self->allocCount;
+    self->allocBytes += size;
+    return myAlloc(base, size);
+  }
+
+  void* TIDY_CALL CountingAllocator::countRealloc(TidyAllocator* base,
+                                                  void* buf, size_t size) {
+    CountingAllocator* self = static_cast<CountingAllocator*>(base);
+    ++self->allocCount;
+    self->allocBytes += size;
+    return myRealloc(base, buf, size);
+  }
+
+  void TIDY_CALL CountingAllocator::countFree(TidyAllocator* base,
+                                             void* buf) {
+    myFree(base, buf);
+  }
+
   void adjustMem(ssize_t diff) {
     WorkerSentinel* worker =
       static_cast<WorkerSentinel*>(Nan::nauv_key_get(&tlsKey));
@@ -101,11 +313,56 @@ namespace node_libtidy {
       assert(diff <= 0);
       return;
     }
-    Nan::AdjustExternalMemory(diff);
+    // Neither is there anyone to tell once the environment is torn down
+    Instance* inst = Instance::Current();
+    if (!inst) return;
+    inst->pendingMem += diff;
+    if (inst->pendingMem >= inst->reportThreshold ||
+        inst->pendingMem <= -inst->reportThreshold) {
+      Nan::AdjustExternalMemory(inst->pendingMem);
+      inst->reportedMem += inst->pendingMem;
+      inst->pendingMem = 0;
+    }
+  }
+
+  NAN_MODULE_INIT(initMemory) {
+    uv_once(&tlsOnce, CreateKey);
+    Nan::SetMethod(target, "configureMemory", configureMemory);
+    Nan::SetMethod(target, "memoryStats", memoryStats);
+  }
+
+  // arguments:
+  // 0 - object with optional property reportThreshold
+  NAN_METHOD(configureMemory) {
+    if (!info[0]->IsObject()) {
+      Nan::ThrowTypeError("Argument to configureMemory must be an object");
+      return;
+    }
+    v8::Local<v8::Value> val =
+      Nan::Get(info[0].As<v8::Object>(),
+               Nan::New("reportThreshold").ToLocalChecked()).ToLocalChecked();
+    if (!val->IsUndefined()) {
+      double num = Nan::To<double>(val).FromJust();
+      if (!(num >= 0 && num <= 0x7fffffff) || num != ssize_t(num)) {
+        Nan::ThrowRangeError("Memory setting 'reportThreshold' "
+                             "must be a non-negative integer");
+        return;
+      }
+      Instance::Current()->reportThreshold = num;
+      adjustMem(0); // report right away if above the new threshold
+    }
   }
 
-  void initMemory() {
-    Nan::nauv_key_create(&tlsKey);
+  NAN_METHOD(memoryStats) {
+    Instance* inst = Instance::Current();
+    v8::Local<v8::Object> res = Nan::New<v8::Object>();
+    Nan::Set(res, Nan::New("held").ToLocalChecked(),
+             Nan::New(inst->reportedMem + inst->pendingMem));
+    Nan::Set(res, Nan::New("reported").ToLocalChecked(),
+             Nan::New(inst->reportedMem));
+    Nan::Set(res, Nan::New("reportThreshold").ToLocalChecked(),
+             Nan::New(double(inst->reportThreshold)));
+    info.GetReturnValue().Set(res);
   }
 
   // Set up in V8 thread
@@ -114,7 +371,7 @@ namespace node_libtidy {
 
   // Tear down in V8 thread
   WorkerParent::~WorkerParent() {
-    Nan::AdjustExternalMemory(memAdjustments);
+    adjustMem(memAdjustments);
   }
 
   // Set up in worker thread
@@ -4,6 +4,89 @@ namespace node_libtidy {
 
   void adjustMem(ssize_t diff);
 
+  // Allocator used by a single document.
+  // By default it behaves just like the global allocator.
+  // In arena mode, blocks are carved out of large chunks,
+  // freeing a block is a no-op and memory only gets returned
+  // once all the chunks are released at the same time.
+  // Either way the allocator keeps track of the memory it holds.
+  class DocAllocator : public TidyAllocator {
+  public:
+    struct Chunk;
+
+    explicit DocAllocator(bool arena);
+    ~DocAllocator();
+
+    bool isArena() const;
+
+    // Libtidy doesn't check for failed allocations,
+    // so exceeding the limit doesn't fail the allocation.
+    // It only gets flagged, and the job using the document
+    // is expected to stop at the next opportunity.
+    // Zero means no limit; setting a limit clears the flag.
+    void setLimit(size_t limit);
+    bool overLimit() const {
+      return exceeded.load(std::memory_order_relaxed);
+    }
+    size_t held() const { return bytes; }
+
+    // Running totals of allocation requests and requested bytes
+    uint64_t allocations() const { return allocCount; }
+    uint64_t allocated() const { return allocBytes; }
+
+    // Hand over all chunks allocated so far,
+    // so that subsequent allocations go to fresh chunks.
+    Chunk* detach();
+
+    // Release chunks previously obtained from detach.
+    static void release(Chunk* chunks);
+
+  private:
+    Chunk* chunks;
+    Chunk* lastChunk;
+    void* last; // most recent allocation, may grow in place
+    size_t bytes;
+    size_t limit;
+    std::atomic<bool> exceeded; // may be read from another thread
+    uint64_t allocCount;
+    uint64_t allocBytes;
+
+    void account(ssize_t diff);
+    void count(size_t size) { ++allocCount; allocBytes += size; }
+    static Chunk* newChunk(size_t size);
+    static void* TIDY_CALL heapAlloc(TidyAllocator* self, size_t size);
+    static void* TIDY_CALL heapRealloc(TidyAllocator* self,
+                                       void* buf, size_t size);
+    static void TIDY_CALL heapFree(TidyAllocator* self, void* buf);
+    static const TidyAllocatorVtbl docHeapVtbl;
+    static void* TIDY_CALL arenaAlloc(TidyAllocator* self, size_t size);
+    static void* TIDY_CALL arenaRealloc(TidyAllocator* self,
+                                        void* buf, size_t size);
+    static void TIDY_CALL arenaFree(TidyAllocator* self, void* buf);
+    static const TidyAllocatorVtbl arenaVtbl;
+  };
+
+  // Allocator for output buffers, which outlive the document they came from.
+  // It takes its blocks from the global allocator, which may free them
+  // as well, and merely counts the requests like a DocAllocator does.
+  class CountingAllocator : public TidyAllocator {
+  public:
+    CountingAllocator();
+
+    uint64_t allocations() const { return allocCount; }
+    uint64_t allocated() const { return allocBytes; }
+
+  private:
+    uint64_t allocCount;
+    uint64_t allocBytes;
+
+    static void* TIDY_CALL countAlloc(TidyAllocator* self, size_t size);
+    static void* TIDY_CALL countRealloc(TidyAllocator* self,
+                                        void* buf, size_t size);
+    static void TIDY_CALL countFree(TidyAllocator* self, void* buf);
+    static const TidyAllocatorVtbl countingVtbl;
+  };
+
   // An object of the following class must be created on the main V8 thread
   // and be kept alive during the execution of a worker thread,
   // to be eventually destroyed on the main V8 thread again.
@@ -29,6 +112,9 @@ namespace node_libtidy {
     WorkerParent& parent;
   };
 
-  void initMemory();
+  NAN_MODULE_INIT(initMemory);
+
+  NAN_METHOD(configureMemory);
+  NAN_METHOD(memoryStats);
 
 }
@@ -0,0 +1,181 @@
+#include "node-libtidy.hh"
+
+#include <cstring>
+#include <sstream>
+
+namespace node_libtidy {
+
+  namespace {
+
+    struct LevelName {
+      TidyReportLevel level;
+      const char* name;
+    };
+
+    const LevelName levelNames[] = {
+      { TidyInfo, "Info" },
+      { TidyWarning, "Warning" },
+      { TidyConfig, "Config" },
+      { TidyAccess, "Access" },
+      { TidyError, "Error" },
+      { TidyBadDocument, "BadDocument" },
+      { TidyFatal, "Fatal" },
+    };
+
+    const size_t numLevels = sizeof(levelNames) / sizeof(levelNames[0]);
+
+    bool GetLevel(v8::Local<v8::Value> val, unsigned& out) {
+      if (val->IsNumber()) {
+        double num = Nan::To<double>(val).FromJust();
+        for (size_t i = 0; i < numLevels; ++i) {
+          if (num == levelNames[i].level) {
+            out = levelNames[i].level;
+            return true;
+          }
+        }
+      } else {
+        Nan::Utf8String str(val);
+        for (size_t i = 0; i < numLevels; ++i) {
+          if (std::strcmp(*str, levelNames[i].name) == 0) {
+            out = levelNames[i].level;
+            return true;
+          }
+        }
+      }
+      std::ostringstream buf;
+      buf << "Unknown message level '" << Nan::Utf8String(val) << "'";
+      Nan::ThrowRangeError(NewString(buf.str()));
+      return false;
+    }
+
+    bool GetArray(v8::Local<v8::Object> opts, const char* name,
+                  v8::Local<v8::Array>& out) {
+      v8::Local<v8::Value> val =
+        Nan::Get(opts, Nan::New(name).ToLocalChecked()).ToLocalChecked();
+      if (val->IsUndefined()) return true;
+      if (!val->IsArray()) {
+        std::ostringstream buf;
+        buf << "Message setting '" << name << "' must be an array";
+        Nan::ThrowTypeError(NewString(buf.str()));
+        return false;
+      }
+      out = val.As<v8::Array>();
+      return true;
+    }
+
+    bool GetStrings(v8::Local<v8::Object> opts, const char* name,
+                    std::set<std::string>& out) {
+      v8::Local<v8::Array> arr;
+      if (!GetArray(opts, name, arr)) return false;
+      if (arr.IsEmpty()) return true;
+      for (uint32_t i = 0, n = arr->Length(); i < n; ++i) {
+        Nan::Utf8String str(Nan::Get(arr, i).ToLocalChecked());
+        out.insert(std::string(*str, str.length()));
+      }
+      return true;
+    }
+
+  }
+
+  NAN_MODULE_INIT(Messages::Init) {
+    v8::Local<v8::Array> arr = Nan::New<v8::Array>();
+    for (size_t i = 0; i < numLevels; ++i)
+      Nan::Set(arr, levelNames[i].level,
+               Nan::New(levelNames[i].name).ToLocalChecked());
+    Nan::Set(target, Nan::New("messageLevels").ToLocalChecked(), arr);
+  }
+
+  Messages::Messages() : enabled(false), levels(~0u) { }
+
+  void Messages::configure(const Messages& other) {
+    enabled = other.enabled;
+    levels = other.levels;
+    include = other.include;
+    exclude = other.exclude;
+    reset();
+  }
+
+  // arguments:
+  // opts - false to disable collecting messages, true to collect all,
+  //        or object with the following optional properties:
+  //        levels - array of level names or numbers to collect
+  //        include - array of message codes to collect, defaults to all
+  //        exclude - array of message codes to suppress
+  bool Messages::configure(v8::Local<v8::Value> opts) {
+    unsigned newLevels = ~0u;
+    std::set<std::string> newInclude, newExclude;
+    if (opts->IsObject()) {
+      v8::Local<v8::Object> obj = opts.As<v8::Object>();
+      v8::Local<v8::Array> arr;
+      if (!GetArray(obj, "levels", arr)) return false;
+      if (!arr.IsEmpty()) {
+        newLevels = 0;
+        for (uint32_t i = 0, n = arr->Length(); i < n; ++i) {
+          unsigned level;
+          if (!GetLevel(Nan::Get(arr, i).ToLocalChecked(), level))
+            return false;
+          newLevels |= 1u << level;
+        }
+      }
+      if (!GetStrings(obj, "include", newInclude)) return false;
+      if (!GetStrings(obj, "exclude", newExclude)) return false;
+      enabled = true;
+    } else {
+      enabled = Nan::To<bool>(opts).FromJust();
+    }
+    levels = newLevels;
+    include.swap(newInclude);
+    exclude.swap(newExclude);
+    lookup.clear();
+    reset();
+    return true;
+  }
+
+  void Messages::reset() {
+    records.clear();
+    codes.clear();
+    // Indices cached in the lookup refer to the cleared code table
+    for (std::map<ctmbstr, int32_t>::iterator i = lookup.begin(),
+           e = lookup.end(); i != e; ++i)
+      if (i->second >= 0) i->second = -2; // known good, but not in table
+  }
+
+  bool Messages::report(TidyReportLevel level, uint line, uint col,
+                        ctmbstr code) {
+    if (!enabled) return true;
+    if (level >= 32 || !(levels & (1u << level))) return false;
+    if (!code) code = "";
+    int32_t index;
+    std::map<ctmbstr, int32_t>::iterator i = lookup.find(code);
+    if (i == lookup.end()) {
+      std::string str(code);
+      bool keep = (include.empty() || include.count(str)) &&
+        !exclude.count(str);
+      i = lookup.insert(std::make_pair(code, keep ? -2 : -1)).first;
+    }
+    index = i->second;
+    if (index == -1) return false;
+    if (index == -2) {
+      index = i->second = codes.size();
+      codes.push_back(code);
+    }
+    records.push_back(level);
+    records.push_back(line);
+    records.push_back(col);
+    records.push_back(index);
+    return false;
+  }
+
+  v8::Local<v8::Object> Messages::result() const {
+    Nan::EscapableHandleScope scope;
+    v8::Local<v8::Int32Array> arr = NewInt32Array(records);
+    v8::Local<v8::Array> names = Nan::New<v8::Array>(codes.size());
+    for (size_t i = 0; i < codes.size(); ++i)
+      Nan::Set(names, i, NewString(codes[i]));
+    v8::Local<v8::Object> res = Nan::New<v8::Object>();
+    Nan::Set(res, Nan::New("records").ToLocalChecked(), arr);
+    Nan::Set(res, Nan::New("codes").ToLocalChecked(), names);
+    return scope.Escape(res);
+  }
+
+}
@@ -0,0 +1,46 @@
+namespace node_libtidy {
+
+  // Diagnostics collected as compact records instead of formatted text.
+  // Each record consists of four integers:
+  // level, line, column and an index into the table of message codes.
+  // Messages suppressed by the filters are never recorded,
+  // and while enabled no message gets written to the text error log.
+  class Messages {
+  public:
+    Messages();
+
+    // Takes the settings but not the records of another collector
+    void configure(const Messages& other);
+
+    // Reads settings from JavaScript; returns false after throwing
+    bool configure(v8::Local<v8::Value> opts);
+
+    bool isEnabled() const { return enabled; }
+    void reset();
+
+    // Called from the report filter, possibly on a worker thread.
+    // Returns whether tidy should still write the message to the log.
+    bool report(TidyReportLevel level, uint line, uint col, ctmbstr code);
+
+    // {records: Int32Array, codes: [string]}
+    v8::Local<v8::Object> result() const;
+
+    static NAN_MODULE_INIT(Init);
+
+  private:
+    bool enabled;
+    unsigned levels; // bit mask of levels to collect
+    std::set<std::string> include; // empty means all codes
+    std::set<std::string> exclude;
+
+    // Codes are static strings in libtidy,
+    // so the decision for each of them gets cached by address.
+    // Negative values mark suppressed codes.
+    std::map<ctmbstr, int32_t> lookup;
+    std::vector<std::string> codes;
+    std::vector<int32_t> records;
+
+    friend class Fragments;
+  };
+
+}
@@ -0,0 +1,181 @@
+#include "node-libtidy.hh"
+
+namespace node_libtidy {
+
+  namespace Metrics {
+
+    namespace {
+
+      const char* const phaseNames[NumPhases] = {
+        "parse",
+        "cleanAndRepair",
+        "runDiagnostics",
+        "extract",
+        "save",
+      };
+
+      // Bucket 0 counts phases which took less than a microsecond,
+      // bucket i those which took at least 2^(i-1) but less than 2^i,
+      // and the last bucket everything beyond.
+      const unsigned numBuckets = 32;
+
+      struct Histogram {
+        double count;
+        double time; // nanoseconds
+        double allocations;
+        double bytes;
+        double buckets[numBuckets];
+      };
+
+      // Shared by all threads running JavaScript, protected by the mutex
+      uv_once_t once = UV_ONCE_INIT;
+      uv_mutex_t mutex;
+      bool enabled = false;
+      Histogram histograms[NumPhases];
+
+      // Call with mutex held
+      void Reset() {
+        for (unsigned i = 0; i < NumPhases; ++i) {
+          Histogram& h = histograms[i];
+          h.count = h.time = h.allocations = h.bytes = 0;
+          for (unsigned j = 0; j < numBuckets; ++j)
+            h.buckets[j] = 0;
+        }
+      }
+
+      void Setup() {
+        uv_mutex_init(&mutex);
+        Reset();
+      }
+
+      unsigned Bucket(uint64_t ns) {
+        uint64_t us = ns / 1000;
+        unsigned i = 0;
+        while (us && i < numBuckets - 1) {
+          us >>= 1;
+          ++i;
+        }
+        return i;
+      }
+
+    }
+
+    Timer::Timer(Sample& sample, const DocAllocator& alloc,
+                 const CountingAllocator* output)
+      : sample(sample), alloc(alloc), output(output), start(uv_hrtime()),
+        allocations(alloc.allocations()), bytes(alloc.allocated())
+    {
+      if (output) {
+        allocations += output->allocations();
+        bytes += output->allocated();
+      }
+    }
+
+    Timer::~Timer() {
+      uint64_t allocationsNow = alloc.allocations();
+      uint64_t bytesNow = alloc.allocated();
+      if (output) {
+        allocationsNow += output->allocations();
+        bytesNow += output->allocated();
+      }
+      sample.ran = true;
+      sample.time += uv_hrtime() - start;
+      sample.allocations += allocationsNow - allocations;
+      sample.bytes += bytesNow - bytes;
+    }
+
+    NAN_MODULE_INIT(Init) {
+      uv_once(&once, Setup);
+      Nan::SetMethod(target, "configureMetrics", configure);
+      Nan::SetMethod(target, "metricsStats", stats);
+    }
+
+    v8::Local<v8::Object> Result(const Sample samples[NumPhases]) {
+      Nan::EscapableHandleScope scope;
+      v8::Local<v8::Object> res = Nan::New<v8::Object>();
+      for (unsigned i = 0; i < NumPhases; ++i) {
+        const Sample& s = samples[i];
+        if (!s.ran) continue;
+        v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+        Nan::Set(obj, Nan::New("time").ToLocalChecked(),
+                 Nan::New(s.time / 1e6));
+        Nan::Set(obj, Nan::New("allocations").ToLocalChecked(),
+                 Nan::New(double(s.allocations)));
+        Nan::Set(obj, Nan::New("bytes").ToLocalChecked(),
+                 Nan::New(double(s.bytes)));
+        Nan::Set(res, Nan::New(phaseNames[i]).ToLocalChecked(), obj);
+      }
+      return scope.Escape(res);
+    }
+
+    void Record(const Sample samples[NumPhases]) {
+      uv_mutex_lock(&mutex);
+      if (!enabled) {
+        uv_mutex_unlock(&mutex);
+        return;
+      }
+      for (unsigned i = 0; i < NumPhases; ++i) {
+        const Sample& s = samples[i];
+        if (!s.ran) continue;
+        Histogram& h = histograms[i];
+        h.count += 1;
+        h.time += s.time;
+        h.allocations += s.allocations;
+        h.bytes += s.bytes;
+        h.buckets[Bucket(s.time)] += 1;
+      }
+      uv_mutex_unlock(&mutex);
+    }
+
+    // arguments:
+    // 0 - object with optional properties
+    //     histogram - boolean whether to aggregate phases of all jobs
+    //     reset - if true, clear the histograms collected so far
+    NAN_METHOD(configure) {
+      if (!info[0]->IsObject()) {
+        Nan::ThrowTypeError("Argument to configureMetrics must be an object");
+        return;
+      }
+      v8::Local<v8::Object> opts = info[0].As<v8::Object>();
+      v8::Local<v8::Value> histogram =
+        Nan::Get(opts, Nan::New("histogram").ToLocalChecked()).ToLocalChecked();
+      v8::Local<v8::Value> reset =
+        Nan::Get(opts, Nan::New("reset").ToLocalChecked()).ToLocalChecked();
+      uv_mutex_lock(&mutex);
+      if (!histogram->IsUndefined())
+        enabled = Nan::To<bool>(histogram).FromJust();
+      if (Nan::To<bool>(reset).FromJust())
+        Reset();
+      uv_mutex_unlock(&mutex);
+    }
+
+    NAN_METHOD(stats) {
+      uv_mutex_lock(&mutex);
+      bool on = enabled;
+      Histogram copy[NumPhases];
+      for (unsigned i = 0; i < NumPhases; ++i)
+        copy[i] = histograms[i];
+      uv_mutex_unlock(&mutex);
+      v8::Local<v8::Object> res = Nan::New<v8::Object>();
+      Nan::Set(res, Nan::New("histogram").ToLocalChecked(), Nan::New(on));
+      for (unsigned i = 0; i < NumPhases; ++i) {
+        const Histogram& h = copy[i];
+        v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+        Nan::Set(obj, Nan::New("count").ToLocalChecked(), Nan::New(h.count));
+        Nan::Set(obj, Nan::New("time").ToLocalChecked(),
+                 Nan::New(h.time / 1e6));
+        Nan::Set(obj, Nan::New("allocations").ToLocalChecked(),
+                 Nan::New(h.allocations));
+        Nan::Set(obj, Nan::New("bytes").ToLocalChecked(), Nan::New(h.bytes));
+        v8::Local<v8::Array> buckets = Nan::New<v8::Array>(numBuckets);
+        for (unsigned j = 0; j < numBuckets; ++j)
+          Nan::Set(buckets, j, Nan::New(h.buckets[j]));
+        Nan::Set(obj, Nan::New("buckets").ToLocalChecked(), buckets);
+        Nan::Set(res, Nan::New(phaseNames[i]).ToLocalChecked(), obj);
+      }
+      info.GetReturnValue().Set(res);
+    }
+
+  }
+
+}
@@ -0,0 +1,53 @@
+namespace node_libtidy {
+
+  // Timing and allocations of the individual phases of a job,
+  // reported with every result and optionally aggregated
+  // into process-wide histograms.
+  namespace Metrics {
+
+    enum Phase {
+      Parse, CleanAndRepair, RunDiagnostics, Extraction, Save, NumPhases
+    };
+
+    struct Sample {
+      bool ran;
+      uint64_t time; // nanoseconds
+      uint64_t allocations;
+      uint64_t bytes;
+    };
+
+    // Measures a single phase on the worker thread,
+    // from construction to destruction.
+    // Repeated phases of the same kind add up.
+    // Saving to a buffer counts the allocations of the output as well.
+    class Timer {
+    public:
+      Timer(Sample& sample, const DocAllocator& alloc,
+            const CountingAllocator* output = NULL);
+      ~Timer();
+    private:
+      Sample& sample;
+      const DocAllocator& alloc;
+      const CountingAllocator* output;
+      uint64_t start;
+      uint64_t allocations;
+      uint64_t bytes;
+    };
+
+    NAN_MODULE_INIT(Init);
+
+    // The following must be called on the main thread
+
+    // {parse: {time, allocations, bytes}, ...} for the phases which ran,
+    // with the time in milliseconds
+    v8::Local<v8::Object> Result(const Sample samples[NumPhases]);
+
+    // Adds to the histograms, if enabled
+    void Record(const Sample samples[NumPhases]);
+
+    NAN_METHOD(configure);
+    NAN_METHOD(stats);
+
+  }
+
+}
@@ -1,10 +1,19 @@
 #include "node-libtidy.hh"
 
 NAN_MODULE_INIT(Init) {
-  node_libtidy::initMemory();
+  node_libtidy::Instance::Init(target);
+  node_libtidy::initMemory(target);
+  node_libtidy::Metrics::Init(target);
+  node_libtidy::Cache::Init(target);
   node_libtidy::Opt::Init(target);
+  node_libtidy::Messages::Init(target);
+  node_libtidy::Tree::Init(target);
+  node_libtidy::Config::Init(target);
   node_libtidy::Doc::Init(target);
+  node_libtidy::InputStream::Init(target);
+  node_libtidy::OutputStream::Init(target);
+  node_libtidy::Pool::Init(target);
   Nan::Set(target, Nan::New("libraryVersion").ToLocalChecked(),
            Nan::New(tidyLibraryVersion()).ToLocalChecked());
 }
-NODE_MODULE(libtidy, Init)
+NAN_MODULE_WORKER_ENABLED(libtidy, Init)
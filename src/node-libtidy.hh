@@ -1,4 +1,10 @@
+#include <atomic>
+#include <deque>
 #include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
 
 #include <nan.h>
 
@@ -8,8 +14,20 @@ extern "C" {
 }
 
 #include "util.hh"
+#include "instance.hh"
 #include "memory.hh"
+#include "metrics.hh"
+#include "cache.hh"
 #include "buf.hh"
+#include "file.hh"
 #include "opt.hh"
+#include "messages.hh"
+#include "tree.hh"
+#include "extract.hh"
+#include "fragments.hh"
 #include "doc.hh"
+#include "config.hh"
+#include "stream.hh"
 #include "worker.hh"
+#include "batch.hh"
+#include "pool.hh"
@@ -1,11 +1,133 @@
 #include "node-libtidy.hh"
+#include <cstring>
+#include <string>
+#include <sstream>
 
 namespace node_libtidy {
 
   namespace Opt {
 
-    Nan::Persistent<v8::FunctionTemplate> constructorTemplate;
-    Nan::Persistent<v8::Function> constructor;
+    namespace {
+
+      v8::Local<v8::Function> Constructor() {
+        return Nan::GetFunction(Nan::New(Instance::Current()->optTemplate))
+          .ToLocalChecked();
+      }
+
+      // NULL for values unknown to this version of the bindings
+      const char* CategoryName(TidyOption opt) {
+        switch (tidyOptGetCategory(opt)) {
+        case TidyMarkup:
+          return "Markup";
+        case TidyDiagnostics:
+          return "Diagnostics";
+        case TidyPrettyPrint:
+          return "PrettyPrint";
+        case TidyEncoding:
+          return "Encoding";
+        case TidyMiscellaneous:
+          return "Miscellaneous";
+        default:
+          return NULL;
+        }
+      }
+
+      const char* TypeName(TidyOption opt) {
+        switch (tidyOptGetType(opt)) {
+        case TidyBoolean:
+          return "boolean";
+        case TidyInteger:
+          return "integer";
+        case TidyString:
+          return "string";
+        default:
+          return NULL;
+        }
+      }
+
+      v8::Local<v8::Value> Default(TidyOption opt) {
+        Nan::EscapableHandleScope scope;
+        v8::Local<v8::Value> res;
+        const char* str;
+        switch (tidyOptGetType(opt)) {
+        case TidyBoolean:
+          res = Nan::New<v8::Boolean>(bb(tidyOptGetDefaultBool(opt)));
+          break;
+        case TidyInteger:
+          res = Nan::New<v8::Number>(tidyOptGetDefaultInt(opt));
+          break;
+        default:
+          str = tidyOptGetDefault(opt);
+          if (str)
+            res = Nan::New<v8::String>(str).ToLocalChecked();
+          else
+            res = Nan::Null();
+          break;
+        }
+        return scope.Escape(res);
+      }
+
+      v8::Local<v8::Array> PickList(TidyOption opt) {
+        Nan::EscapableHandleScope scope;
+        v8::Local<v8::Array> arr = Nan::New<v8::Array>();
+        TidyIterator iter = tidyOptGetPickList(opt);
+        while (iter) {
+          const char* pick = tidyOptGetNextPick(opt, &iter);
+          v8::Local<v8::Value> str =
+            Nan::New<v8::String>(pick).ToLocalChecked();
+          Nan::Set(arr, arr->Length(), str);
+        }
+        return scope.Escape(arr);
+      }
+
+      // The name as used for the keys of the options object
+      v8::Local<v8::String> Key(TidyOption opt) {
+        std::string name = tidyOptGetName(opt);
+        for (std::string::size_type i = 0; i < name.length(); ++i)
+          if (name[i] == '-') name[i] = '_';
+        return NewString(name);
+      }
+
+      bool IsDefault(TidyDoc doc, TidyOption opt) {
+        TidyOptionId id = tidyOptGetId(opt);
+        const char *val, *def;
+        switch (tidyOptGetType(opt)) {
+        case TidyBoolean:
+          return tidyOptGetBool(doc, id) == tidyOptGetDefaultBool(opt);
+        case TidyInteger:
+          return tidyOptGetInt(doc, id) == tidyOptGetDefaultInt(opt);
+        default:
+          val = tidyOptGetValue(doc, id);
+          def = tidyOptGetDefault(opt);
+          if (!val || !def) return val == def;
+          return std::strcmp(val, def) == 0;
+        }
+      }
+
+      // Everything the TidyOption accessors would return,
+      // as a plain object which never goes back into C
+      v8::Local<v8::Object> Describe(TidyOption opt) {
+        Nan::EscapableHandleScope scope;
+        v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+        const char* category = CategoryName(opt);
+        const char* type = TypeName(opt);
+        Nan::Set(obj, Nan::New("id").ToLocalChecked(),
+                 Nan::New<v8::Number>(tidyOptGetId(opt)));
+        Nan::Set(obj, Nan::New("name").ToLocalChecked(),
+                 Nan::New(tidyOptGetName(opt)).ToLocalChecked());
+        Nan::Set(obj, Nan::New("key").ToLocalChecked(), Key(opt));
+        Nan::Set(obj, Nan::New("category").ToLocalChecked(), category ?
+                 Nan::New(category).ToLocalChecked() : Nan::EmptyString());
+        Nan::Set(obj, Nan::New("type").ToLocalChecked(), type ?
+                 Nan::New(type).ToLocalChecked() : Nan::EmptyString());
+        Nan::Set(obj, Nan::New("default").ToLocalChecked(), Default(opt));
+        Nan::Set(obj, Nan::New("readOnly").ToLocalChecked(),
+                 Nan::New<v8::Boolean>(bb(tidyOptIsReadOnly(opt))));
+        Nan::Set(obj, Nan::New("pickList").ToLocalChecked(), PickList(opt));
+        return scope.Escape(obj);
+      }
+
+    }
 
     NAN_MODULE_INIT(Init) {
       v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
@@ -22,10 +144,21 @@ namespace node_libtidy {
       SetAccessor(tpl, itpl, "readOnly", getReadOnly);
       SetAccessor(tpl, itpl, "type", getType);
 
-      constructorTemplate.Reset(tpl);
-      constructor.Reset(Nan::GetFunction(tpl).ToLocalChecked());
+      tpl = Instance::Keep(Instance::Current()->optTemplate, tpl);
       Nan::Set(target, Nan::New("TidyOption").ToLocalChecked(),
                Nan::GetFunction(tpl).ToLocalChecked());
+
+      // The options are the same for every document,
+      // so describe them once instead of on every request
+      TidyDoc doc = tidyCreateWithAllocator(&allocator);
+      v8::Local<v8::Array> table = Nan::New<v8::Array>();
+      TidyIterator iter = tidyGetOptionList(doc);
+      while (iter) {
+        TidyOption opt = tidyGetNextOption(doc, &iter);
+        Nan::Set(table, table->Length(), Describe(opt));
+      }
+      tidyRelease(doc);
+      Nan::Set(target, Nan::New("optionTable").ToLocalChecked(), table);
     }
 
     NAN_METHOD(New) {
@@ -33,14 +166,14 @@ namespace node_libtidy {
         Nan::SetInternalFieldPointer(info.This(), 0, NULL);
         info.GetReturnValue().Set(info.This());
       } else {
-        v8::Local<v8::Function> cons = Nan::New(constructor);
+        v8::Local<v8::Function> cons = Constructor();
         info.GetReturnValue().Set(Nan::NewInstance(cons).ToLocalChecked());
       }
     }
 
     v8::Local<v8::Object> Create(TidyOption opt) {
       Nan::EscapableHandleScope scope;
-      v8::Local<v8::Function> cons = Nan::New(constructor);
+      v8::Local<v8::Function> cons = Constructor();
       v8::Local<v8::Object> obj = Nan::NewInstance(cons).ToLocalChecked();
       Nan::SetInternalFieldPointer
         (obj, 0, const_cast<void*>(reinterpret_cast<const void*>(opt)));
@@ -48,7 +181,8 @@ namespace node_libtidy {
     }
 
     TidyOption Unwrap(v8::Local<v8::Value> value) {
-      v8::Local<v8::FunctionTemplate> tpl = Nan::New(constructorTemplate);
+      v8::Local<v8::FunctionTemplate> tpl =
+        Nan::New(Instance::Current()->optTemplate);
       if (!tpl->HasInstance(value)) {
         Nan::ThrowTypeError("Not a valid TidyOption object");
         return NULL;
@@ -68,6 +202,137 @@ namespace node_libtidy {
       return opt;
     }
 
+    TidyOption Resolve(TidyDoc doc, v8::Local<v8::Value> key) {
+      TidyOption opt = NULL;
+      {
+        Nan::TryCatch tryCatch;
+        opt = Unwrap(key);
+        if (opt || !tryCatch.CanContinue()) return opt;
+      }
+      if (key->IsNumber()) {
+        double dnum = Nan::To<double>(key).FromJust();
+        int inum = dnum;
+        if (dnum != inum) {
+          Nan::ThrowTypeError("Option id must be an integer");
+        } else if (inum <= 0 || inum > N_TIDY_OPTIONS) {
+          Nan::ThrowRangeError("Option id outside range of allowed options");
+        } else {
+          opt = tidyGetOption(doc, TidyOptionId(inum));
+          if (!opt) {
+            Nan::ThrowError("No option with this id");
+          }
+        }
+        return opt;
+      }
+      Nan::Utf8String str1(key);
+      std::string str2(*str1, str1.length());
+      for (std::string::size_type i = str2.length() - 1; i > 0; --i) {
+        if (str2[i] == '_') str2[i] = '-';
+        if (str2[i] >= 'A' && str2[i] <= 'Z' &&
+            str2[i - 1] >= 'a' && str2[i - 1] <= 'z') {
+          str2[i] = str2[i] + ('a' - 'A');
+          str2.insert(i, 1, '-');
+        }
+      }
+      opt = tidyGetOptionByName(doc, str2.c_str());
+      if (!opt) {
+        std::ostringstream buf;
+        buf << "Option '" << str2 << "' unknown";
+        Nan::ThrowError(NewString(buf.str()));
+      }
+      return opt;
+    }
+
+    v8::Local<v8::Value> Get(TidyDoc doc, TidyOption opt) {
+      Nan::EscapableHandleScope scope;
+      TidyOptionId id = tidyOptGetId(opt);
+      const char* str;
+      v8::Local<v8::Value> res;
+      switch (tidyOptGetType(opt)) {
+      case TidyBoolean:
+        res = Nan::New<v8::Boolean>(bb(tidyOptGetBool(doc, id)));
+        break;
+      case TidyInteger:
+        str = tidyOptGetCurrPick(doc, id);
+        if (str)
+          res = Nan::New<v8::String>(str).ToLocalChecked();
+        else
+          res = Nan::New<v8::Number>(tidyOptGetInt(doc, id));
+        break;
+      default:
+        str = tidyOptGetValue(doc, id);
+        if (str)
+          res = Nan::New<v8::String>(str).ToLocalChecked();
+        else
+          res = Nan::Null();
+      }
+      return scope.Escape(res);
+    }
+
+    bool Set(TidyDoc doc, TidyOption opt, v8::Local<v8::Value> val, Buf& err) {
+      if (tidyOptIsReadOnly(opt) != no) {
+        std::ostringstream buf;
+        buf << "Option '" << tidyOptGetName(opt) << "' is readonly";
+        Nan::ThrowError(NewString(buf.str()));
+        return false;
+      }
+      TidyOptionId id = tidyOptGetId(opt);
+      Bool rc;
+      if (val->IsBoolean() && tidyOptGetType(opt) == TidyBoolean) {
+        rc = tidyOptSetBool(doc, id, bb(Nan::To<bool>(val).FromJust()));
+      } else if (val->IsNumber() && tidyOptGetType(opt) == TidyInteger) {
+        rc = tidyOptSetInt(doc, id, Nan::To<double>(val).FromJust());
+      } else if (val->IsNull() || val->IsUndefined()) {
+        rc = tidyOptSetValue(doc, id, "");
+      } else {
+        Nan::Utf8String str(val);
+        rc = tidyOptSetValue(doc, id, *str);
+      }
+      if (rc != yes) {
+        std::ostringstream buf;
+        buf << "Failed to set option '" << tidyOptGetName(opt)
+            << "' to value '" << Nan::Utf8String(val) << "'";
+        if (!err.isEmpty()) {
+          buf << " - " << err;
+        }
+        Nan::ThrowError(NewString(trim(buf.str())));
+        return false;
+      }
+      return true;
+    }
+
+    v8::Local<v8::Object> GetAll(TidyDoc doc, bool changedOnly) {
+      Nan::EscapableHandleScope scope;
+      v8::Local<v8::Object> res = Nan::New<v8::Object>();
+      TidyIterator iter = tidyGetOptionList(doc);
+      while (iter) {
+        TidyOption opt = tidyGetNextOption(doc, &iter);
+        if (changedOnly &&
+            (tidyOptIsReadOnly(opt) != no || IsDefault(doc, opt)))
+          continue;
+        Nan::Set(res, Key(opt), Get(doc, opt));
+      }
+      return scope.Escape(res);
+    }
+
+    bool SetAll(TidyDoc doc, v8::Local<v8::Object> opts, Buf& err) {
+      v8::Local<v8::Array> keys = Nan::GetPropertyNames(opts)
+        .ToLocalChecked();
+      uint32_t n = keys->Length();
+      // Resolve all keys first, so that a typo changes nothing
+      std::vector<TidyOption> resolved(n);
+      for (uint32_t i = 0; i < n; ++i) {
+        resolved[i] = Resolve(doc, Nan::Get(keys, i).ToLocalChecked());
+        if (!resolved[i]) return false;
+      }
+      for (uint32_t i = 0; i < n; ++i) {
+        v8::Local<v8::Value> val =
+          Nan::Get(opts, Nan::Get(keys, i).ToLocalChecked()).ToLocalChecked();
+        if (!Set(doc, resolved[i], val, err)) return false;
+      }
+      return true;
+    }
+
     NAN_METHOD(toString) {
       TidyOption opt = Unwrap(info.Holder()); if (!opt) return;
       const char* res = tidyOptGetName(opt);
@@ -76,24 +341,8 @@ namespace node_libtidy {
 
     NAN_PROPERTY_GETTER(getCategory) {
       TidyOption opt = Unwrap(info.Holder()); if (!opt) return;
-      const char* res;
-      switch (tidyOptGetCategory(opt)) {
-      case TidyMarkup:
-        res = "Markup";
-        break;
-      case TidyDiagnostics:
-        res = "Diagnostics";
-        break;
-      case TidyPrettyPrint:
-        res = "PrettyPrint";
-        break;
-      case TidyEncoding:
-        res = "Encoding";
-        break;
-      case TidyMiscellaneous:
-        res = "Miscellaneous";
-        break;
-      default:
+      const char* res = CategoryName(opt);
+      if (!res) {
         Nan::ThrowError("Unknown option category");
         return;
       }
@@ -102,23 +351,7 @@ namespace node_libtidy {
 
     NAN_PROPERTY_GETTER(getDefault) {
       TidyOption opt = Unwrap(info.Holder()); if (!opt) return;
-      switch (tidyOptGetType(opt)) {
-      case TidyBoolean:
-        info.GetReturnValue().Set(Nan::New<v8::Boolean>
-                                  (bb(tidyOptGetDefaultBool(opt))));
-        break;
-      case TidyInteger:
-        info.GetReturnValue().Set(Nan::New<v8::Number>
-                                  (tidyOptGetDefaultInt(opt)));
-        break;
-      default:
-        const char* res = tidyOptGetDefault(opt);
-        if (res)
-          info.GetReturnValue().Set(Nan::New<v8::String>(res).ToLocalChecked());
-        else
-          info.GetReturnValue().Set(Nan::Null());
-        break;
-      }
+      info.GetReturnValue().Set(Default(opt));
     }
 
     NAN_PROPERTY_GETTER(getId) {
@@ -135,14 +368,7 @@ namespace node_libtidy {
 
     NAN_PROPERTY_GETTER(getPickList) {
       TidyOption opt = Unwrap(info.Holder()); if (!opt) return;
-      v8::Local<v8::Array> arr = Nan::New<v8::Array>();
-      TidyIterator iter = tidyOptGetPickList(opt);
-      while (iter) {
-        const char* pick = tidyOptGetNextPick(opt, &iter);
-        v8::Local<v8::Value> str = Nan::New<v8::String>(pick).ToLocalChecked();
-        Nan::Set(arr, arr->Length(), str);
-      }
-      info.GetReturnValue().Set(arr);
+      info.GetReturnValue().Set(PickList(opt));
     }
 
     NAN_PROPERTY_GETTER(getReadOnly) {
@@ -152,18 +378,8 @@ namespace node_libtidy {
 
     NAN_PROPERTY_GETTER(getType) {
       TidyOption opt = Unwrap(info.Holder()); if (!opt) return;
-      const char* res;
-      switch (tidyOptGetType(opt)) {
-      case TidyBoolean:
-        res = "boolean";
-        break;
-      case TidyInteger:
-        res = "integer";
-        break;
-      case TidyString:
-        res = "string";
-        break;
-      default:
+      const char* res = TypeName(opt);
+      if (!res) {
         Nan::ThrowError("Unknown option type");
         return;
       }
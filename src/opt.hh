@@ -2,12 +2,32 @@ namespace node_libtidy {
 
   namespace Opt {
 
-    extern Nan::Persistent<v8::Function> constructor;
     NAN_MODULE_INIT(Init);
     NAN_METHOD(New);
     v8::Local<v8::Object> Create(TidyOption opt);
     TidyOption Unwrap(v8::Local<v8::Value> object);
 
+    // Looks up an option given as TidyOption object, id or name.
+    // Returns NULL after throwing if there is no such option.
+    TidyOption Resolve(TidyDoc doc, v8::Local<v8::Value> key);
+
+    // Gets the current value of an option of the document
+    v8::Local<v8::Value> Get(TidyDoc doc, TidyOption opt);
+
+    // Sets an option of the document, using err for diagnostics.
+    // Returns false after throwing if the value was rejected.
+    bool Set(TidyDoc doc, TidyOption opt, v8::Local<v8::Value> val, Buf& err);
+
+    // Gets all options of the document as a plain object,
+    // keyed like TidyDoc.options, or only those which are writable
+    // and differ from their default
+    v8::Local<v8::Object> GetAll(TidyDoc doc, bool changedOnly);
+
+    // Sets all the options of the object, after resolving their keys.
+    // Returns false after throwing, which leaves the document unchanged
+    // for an unknown key but not for a rejected value.
+    bool SetAll(TidyDoc doc, v8::Local<v8::Object> opts, Buf& err);
+
     NAN_METHOD(toString);
     NAN_PROPERTY_GETTER(getCategory);
     NAN_PROPERTY_GETTER(getDefault);
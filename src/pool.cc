@@ -0,0 +1,284 @@
+#include "node-libtidy.hh"
+
+#include <queue>
+#include <sstream>
+#include <vector>
+
+namespace node_libtidy {
+
+  namespace Pool {
+
+    namespace {
+
+      struct Job {
+        TidyWorker* worker;
+        Instance* instance; // receives the result
+        int priority;
+        unsigned long seq;
+
+        // std::priority_queue pops the largest element first.
+        // Among jobs of equal priority the older one should win.
+        bool operator<(const Job& other) const {
+          if (priority != other.priority)
+            return priority < other.priority;
+          return seq > other.seq;
+        }
+      };
+
+      // The threads are shared by all isolates loading the addon.
+      // Each job gets delivered back to the one which queued it.
+      uv_once_t once = UV_ONCE_INIT;
+
+      // All of the following is protected by the mutex
+      uv_mutex_t mutex;
+      uv_cond_t cond;    // also signalled whenever a job is done
+      std::priority_queue<Job> pending;
+      std::vector<Job> running;
+      unsigned size;     // configured number of threads
+      unsigned live;     // number of threads currently running
+      // Threads which left Work but haven't been joined yet,
+      // since libuv creates them joinable
+      std::vector<uv_thread_t> exited;
+      unsigned maxQueue = 0; // zero means unlimited
+      unsigned long seq = 0;
+      double completed = 0;
+      double rejected = 0;
+
+      void Work(void*) {
+        uv_mutex_lock(&mutex);
+        for (;;) {
+          // Surplus threads exit once the pool got shrunk,
+          // but if it got shrunk to zero the queue must be drained first.
+          if (live > size && (size > 0 || pending.empty()))
+            break;
+          if (pending.empty()) {
+            uv_cond_wait(&cond, &mutex);
+            continue;
+          }
+          Job job = pending.top();
+          pending.pop();
+          running.push_back(job);
+          uv_mutex_unlock(&mutex);
+          job.worker->Execute();
+          uv_mutex_lock(&mutex);
+          for (std::vector<Job>::iterator i = running.begin(),
+                 e = running.end(); i != e; ++i) {
+            if (i->worker == job.worker) {
+              running.erase(i);
+              break;
+            }
+          }
+          job.instance->poolDone.push_back(job.worker);
+          uv_async_send(job.instance->poolAsync);
+          uv_cond_broadcast(&cond); // Detach might be waiting for it
+        }
+        --live;
+        exited.push_back(uv_thread_self());
+        uv_mutex_unlock(&mutex);
+      }
+
+      void Complete(uv_async_t* handle) {
+        Instance* inst = static_cast<Instance*>(handle->data);
+        std::vector<TidyWorker*> finished;
+        uv_mutex_lock(&mutex);
+        finished.swap(inst->poolDone);
+        completed += finished.size();
+        uv_mutex_unlock(&mutex);
+        Nan::HandleScope scope;
+        for (std::vector<TidyWorker*>::iterator i = finished.begin(),
+               e = finished.end(); i != e; ++i) {
+          (*i)->WorkComplete();
+          (*i)->Destroy();
+        }
+        inst->poolOutstanding -= finished.size();
+        // Don't keep the event loop alive while there is nothing to do
+        if (inst->poolOutstanding == 0)
+          uv_unref(reinterpret_cast<uv_handle_t*>(handle));
+      }
+
+      void Closed(uv_handle_t* handle) {
+        delete reinterpret_cast<uv_async_t*>(handle);
+      }
+
+      // Call with mutex held. Threads in the list have released the mutex
+      // before they got there, so joining them doesn't wait for long.
+      void Reap() {
+        for (std::vector<uv_thread_t>::iterator i = exited.begin(),
+               e = exited.end(); i != e; ++i)
+          uv_thread_join(&*i);
+        exited.clear();
+      }
+
+      // Call with mutex held
+      void Spawn() {
+        Reap();
+        while (live < size) {
+          uv_thread_t thread;
+          if (uv_thread_create(&thread, Work, NULL)) break;
+          ++live;
+        }
+      }
+
+      void Start(Instance* inst) {
+        if (inst->poolAsync) return;
+        uv_async_t* async = new uv_async_t;
+        async->data = inst;
+        uv_async_init(inst->loop, async, Complete);
+        uv_unref(reinterpret_cast<uv_handle_t*>(async));
+        inst->poolAsync = async;
+      }
+
+      unsigned DefaultSize() {
+        uv_cpu_info_t* cpus;
+        int count;
+        if (uv_cpu_info(&cpus, &count)) return 4;
+        uv_free_cpu_info(cpus, count);
+        return count > 0 ? count : 1;
+      }
+
+      void Setup() {
+        uv_mutex_init(&mutex);
+        uv_cond_init(&cond);
+        size = DefaultSize();
+        live = 0;
+      }
+
+      bool GetCount(v8::Local<v8::Object> opts, const char* name,
+                    unsigned& out) {
+        v8::Local<v8::Value> val =
+          Nan::Get(opts, Nan::New(name).ToLocalChecked()).ToLocalChecked();
+        if (val->IsUndefined()) return true;
+        double num = Nan::To<double>(val).FromJust();
+        if (!(num >= 0 && num <= 0xffff) || num != unsigned(num)) {
+          std::ostringstream buf;
+          buf << "Pool setting '" << name
+              << "' must be a non-negative integer";
+          Nan::ThrowRangeError(NewString(buf.str()));
+          return false;
+        }
+        out = num;
+        return true;
+      }
+
+    }
+
+    NAN_MODULE_INIT(Init) {
+      uv_once(&once, Setup);
+      Nan::SetMethod(target, "configurePool", configure);
+      Nan::SetMethod(target, "poolStats", stats);
+    }
+
+    bool Queue(TidyWorker* worker, int priority) {
+      Instance* inst = Instance::Current();
+      uv_mutex_lock(&mutex);
+      if (size == 0) { // explicitly configured to use the libuv threadpool
+        uv_mutex_unlock(&mutex);
+        Nan::AsyncQueueWorker(worker);
+        return true;
+      }
+      if (maxQueue && pending.size() >= maxQueue) {
+        ++rejected;
+        uv_mutex_unlock(&mutex);
+        return false;
+      }
+      Start(inst);
+      Job job = { worker, inst, priority, seq++ };
+      pending.push(job);
+      Spawn();
+      uv_cond_signal(&cond);
+      uv_mutex_unlock(&mutex);
+      if (inst->poolOutstanding++ == 0)
+        uv_ref(reinterpret_cast<uv_handle_t*>(inst->poolAsync));
+      return true;
+    }
+
+    // Without threads of its own, the pool uses the libuv threadpool,
+    // whose default size is four
+    unsigned Threads() {
+      uv_mutex_lock(&mutex);
+      unsigned res = size ? size : 4;
+      uv_mutex_unlock(&mutex);
+      return res;
+    }
+
+    void Detach(Instance* inst) {
+      if (!inst->poolAsync) return; // never queued anything
+      std::vector<TidyWorker*> dropped;
+      uv_mutex_lock(&mutex);
+      std::priority_queue<Job> others;
+      for (; !pending.empty(); pending.pop()) {
+        if (pending.top().instance == inst)
+          dropped.push_back(pending.top().worker);
+        else
+          others.push(pending.top());
+      }
+      pending.swap(others);
+      for (;;) {
+        bool busy = false;
+        for (std::vector<Job>::iterator i = running.begin(),
+               e = running.end(); i != e; ++i) {
+          if (i->instance == inst) {
+            i->worker->Abort();
+            busy = true;
+          }
+        }
+        if (!busy) break;
+        uv_cond_wait(&cond, &mutex);
+      }
+      dropped.insert(dropped.end(),
+                     inst->poolDone.begin(), inst->poolDone.end());
+      inst->poolDone.clear();
+      uv_mutex_unlock(&mutex);
+      // Nobody is left to receive the results
+      for (std::vector<TidyWorker*>::iterator i = dropped.begin(),
+             e = dropped.end(); i != e; ++i)
+        delete *i;
+      inst->poolAsync->data = NULL;
+      uv_close(reinterpret_cast<uv_handle_t*>(inst->poolAsync), Closed);
+      inst->poolAsync = NULL;
+    }
+
+    // arguments:
+    // 0 - object with optional properties threads and maxQueue
+    NAN_METHOD(configure) {
+      if (!info[0]->IsObject()) {
+        Nan::ThrowTypeError("Argument to configurePool must be an object");
+        return;
+      }
+      v8::Local<v8::Object> opts = info[0].As<v8::Object>();
+      uv_mutex_lock(&mutex);
+      unsigned threads = size, queue = maxQueue;
+      uv_mutex_unlock(&mutex);
+      if (!GetCount(opts, "threads", threads)) return;
+      if (!GetCount(opts, "maxQueue", queue)) return;
+      uv_mutex_lock(&mutex);
+      size = threads;
+      maxQueue = queue;
+      Reap();
+      if (!pending.empty())
+        Spawn();
+      uv_cond_broadcast(&cond); // let surplus threads exit
+      uv_mutex_unlock(&mutex);
+    }
+
+    NAN_METHOD(stats) {
+      v8::Local<v8::Object> res = Nan::New<v8::Object>();
+      uv_mutex_lock(&mutex);
+      double threads = size, alive = live, active = running.size(),
+        queued = pending.size(), limit = maxQueue, done = completed,
+        refused = rejected;
+      uv_mutex_unlock(&mutex);
+      Nan::Set(res, Nan::New("threads").ToLocalChecked(), Nan::New(threads));
+      Nan::Set(res, Nan::New("running").ToLocalChecked(), Nan::New(alive));
+      Nan::Set(res, Nan::New("busy").ToLocalChecked(), Nan::New(active));
+      Nan::Set(res, Nan::New("queued").ToLocalChecked(), Nan::New(queued));
+      Nan::Set(res, Nan::New("maxQueue").ToLocalChecked(), Nan::New(limit));
+      Nan::Set(res, Nan::New("completed").ToLocalChecked(), Nan::New(done));
+      Nan::Set(res, Nan::New("rejected").ToLocalChecked(),
+               Nan::New(refused));
+      info.GetReturnValue().Set(res);
+    }
+
+  }
+
+}
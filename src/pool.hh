@@ -0,0 +1,29 @@
+namespace node_libtidy {
+
+  // Dedicated native threads for tidy jobs,
+  // so that large documents don't compete with fs, dns or crypto work
+  // for the threads of the shared libuv pool.
+  namespace Pool {
+
+    NAN_MODULE_INIT(Init);
+
+    // Must be called on a thread running JavaScript.
+    // Returns false if the job was rejected because the queue is full.
+    // Otherwise the pool owns the worker, will call its Execute method
+    // on one of its threads and WorkComplete and Destroy on the thread
+    // which queued it. Jobs with higher priority get executed first.
+    bool Queue(TidyWorker* worker, int priority);
+
+    // Number of jobs which can run at the same time
+    unsigned Threads();
+
+    // Drops the jobs of an isolate which is going away,
+    // waiting for those which are running right now to abort.
+    void Detach(Instance* instance);
+
+    NAN_METHOD(configure);
+    NAN_METHOD(stats);
+
+  }
+
+}
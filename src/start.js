@@ -0,0 +1,33 @@
+"use strict";
+
+// Start a job by calling run(resolve, reject), which throws if the job
+// doesn't get accepted, and abort it if the signal of the document fires
+// before the job is done.
+function start(doc, run) {
+  var signal = doc.signal;
+  var onAbort = () => doc.abort();
+  var watching = false;
+  var res = new Promise((resolve, reject) => {
+    run(resolve, reject);
+    if (!signal) return;
+    if (signal.aborted) {
+      doc.abort();
+    } else {
+      signal.addEventListener("abort", onAbort);
+      watching = true;
+    }
+  });
+  if (!signal) return res;
+  var unwatch = () => {
+    if (watching) signal.removeEventListener("abort", onAbort);
+  };
+  return res.then(res => {
+    unwatch();
+    return res;
+  }, err => {
+    unwatch();
+    throw err;
+  });
+}
+
+module.exports = start;
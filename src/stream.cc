@@ -0,0 +1,385 @@
+#include "node-libtidy.hh"
+
+#include <cstring>
+
+namespace node_libtidy {
+
+  namespace {
+
+    // Calls a method of the object, if it has one, from the event loop
+    v8::Local<v8::Value> CallMethod(v8::Local<v8::Object> obj,
+                                    const char* name,
+                                    int argc, v8::Local<v8::Value> argv[]) {
+      v8::Local<v8::Value> fun =
+        Nan::Get(obj, Nan::New(name).ToLocalChecked()).ToLocalChecked();
+      if (!fun->IsFunction())
+        return Nan::Undefined();
+      Nan::Callback cb(fun.As<v8::Function>());
+      return cb(obj, argc, argv);
+    }
+
+  }
+
+  NAN_MODULE_INIT(InputStream::Init) {
+    v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
+    tpl->SetClassName(Nan::New("TidyInputStream").ToLocalChecked());
+    tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+    Nan::SetPrototypeMethod(tpl, "push", push);
+    Nan::SetPrototypeMethod(tpl, "end", end);
+
+    tpl = Instance::Keep(Instance::Current()->inputStreamTemplate, tpl);
+    Nan::Set(target, Nan::New("TidyInputStream").ToLocalChecked(),
+             Nan::GetFunction(tpl).ToLocalChecked());
+  }
+
+  InputStream* InputStream::Unwrap(v8::Local<v8::Value> value) {
+    v8::Local<v8::FunctionTemplate> tpl =
+      Nan::New(Instance::Current()->inputStreamTemplate);
+    if (!tpl->HasInstance(value)) return NULL;
+    return Nan::ObjectWrap::Unwrap<InputStream>(value.As<v8::Object>());
+  }
+
+  InputStream::InputStream(size_t highWaterMark)
+    : pos(0), queued(0), ended(false), wantDrain(false),
+      highWaterMark(highWaterMark)
+  {
+    tidyInitSource(&src, this, getByte, ungetByte, isEOF);
+    current.data = NULL;
+    current.size = 0;
+    uv_mutex_init(&mutex);
+    uv_cond_init(&cond);
+    async = new uv_async_t;
+    async->data = this;
+    uv_async_init(Nan::GetCurrentEventLoop(), async, Drained);
+    uv_unref(reinterpret_cast<uv_handle_t*>(async));
+  }
+
+  InputStream::~InputStream() {
+    if (current.data)
+      allocator.vtbl->free(&allocator, current.data);
+    for (std::deque<Chunk>::iterator i = queue.begin(), e = queue.end();
+         i != e; ++i)
+      allocator.vtbl->free(&allocator, i->data);
+    async->data = NULL;
+    uv_close(reinterpret_cast<uv_handle_t*>(async), Closed);
+    uv_cond_destroy(&cond);
+    uv_mutex_destroy(&mutex);
+  }
+
+  // arguments:
+  // 0 - optional number of queued bytes before push returns false
+  // Once the queue has drained after push returned false,
+  // the ondrain method of the object gets called.
+  NAN_METHOD(InputStream::New) {
+    if (!info.IsConstructCall()) {
+      Nan::ThrowTypeError("TidyInputStream must be called with new");
+      return;
+    }
+    size_t highWaterMark = 64 * 1024;
+    if (info[0]->IsNumber())
+      highWaterMark = Nan::To<uint32_t>(info[0]).FromJust();
+    InputStream* obj = new InputStream(highWaterMark);
+    obj->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+  }
+
+  // arguments:
+  // 0 - buffer to append to the input
+  // Returns false if the caller should wait for the drain callback.
+  NAN_METHOD(InputStream::push) {
+    InputStream* self = Unwrap(info.Holder());
+    if (!self) {
+      Nan::ThrowTypeError("Not a valid TidyInputStream object");
+      return;
+    }
+    if (!node::Buffer::HasInstance(info[0])) {
+      Nan::ThrowTypeError("Argument to push must be a buffer");
+      return;
+    }
+    Chunk chunk;
+    chunk.size = node::Buffer::Length(info[0]);
+    if (chunk.size == 0) {
+      info.GetReturnValue().Set(Nan::True());
+      return;
+    }
+    // Copy the data, since the parsing thread can't release a JS Buffer
+    chunk.data = static_cast<byte*>
+      (allocator.vtbl->alloc(&allocator, chunk.size));
+    if (!chunk.data) {
+      Nan::ThrowError("Failed to allocate input chunk");
+      return;
+    }
+    std::memcpy(chunk.data, node::Buffer::Data(info[0]), chunk.size);
+    uv_mutex_lock(&self->mutex);
+    if (self->ended) { // silently drop data after the end
+      uv_mutex_unlock(&self->mutex);
+      allocator.vtbl->free(&allocator, chunk.data);
+      info.GetReturnValue().Set(Nan::False());
+      return;
+    }
+    self->queue.push_back(chunk);
+    self->queued += chunk.size;
+    bool ok = self->queued < self->highWaterMark;
+    if (!ok)
+      self->wantDrain = true;
+    uv_cond_signal(&self->cond);
+    uv_mutex_unlock(&self->mutex);
+    info.GetReturnValue().Set(Nan::New(ok));
+  }
+
+  NAN_METHOD(InputStream::end) {
+    InputStream* self = Unwrap(info.Holder());
+    if (!self) {
+      Nan::ThrowTypeError("Not a valid TidyInputStream object");
+      return;
+    }
+    self->close();
+  }
+
+  void InputStream::close() {
+    uv_mutex_lock(&mutex);
+    ended = true;
+    uv_cond_signal(&cond);
+    uv_mutex_unlock(&mutex);
+  }
+
+  // Releases the current chunk and waits for the next one.
+  // Returns false once the end of the input has been reached.
+  bool InputStream::next() {
+    if (current.data) {
+      allocator.vtbl->free(&allocator, current.data);
+      current.data = NULL;
+      current.size = pos = 0;
+    }
+    uv_mutex_lock(&mutex);
+    while (queue.empty() && !ended)
+      uv_cond_wait(&cond, &mutex);
+    if (queue.empty()) {
+      uv_mutex_unlock(&mutex);
+      return false;
+    }
+    current = queue.front();
+    queue.pop_front();
+    queued -= current.size;
+    bool notify = wantDrain && queued < highWaterMark;
+    if (notify)
+      wantDrain = false;
+    uv_mutex_unlock(&mutex);
+    if (notify)
+      uv_async_send(async);
+    return true;
+  }
+
+  int TIDY_CALL InputStream::getByte(void* data) {
+    InputStream* self = static_cast<InputStream*>(data);
+    if (!self->pushedBack.empty()) {
+      byte bt = self->pushedBack.back();
+      self->pushedBack.pop_back();
+      return bt;
+    }
+    while (self->pos == self->current.size)
+      if (!self->next()) return EndOfStream;
+    return self->current.data[self->pos++];
+  }
+
+  void TIDY_CALL InputStream::ungetByte(void* data, byte bt) {
+    InputStream* self = static_cast<InputStream*>(data);
+    if (self->pushedBack.empty() && self->pos > 0)
+      --self->pos;
+    else
+      self->pushedBack.push_back(bt);
+  }
+
+  Bool TIDY_CALL InputStream::isEOF(void* data) {
+    InputStream* self = static_cast<InputStream*>(data);
+    if (!self->pushedBack.empty()) return no;
+    while (self->pos == self->current.size)
+      if (!self->next()) return yes;
+    return no;
+  }
+
+  void InputStream::Drained(uv_async_t* handle) {
+    InputStream* self = static_cast<InputStream*>(handle->data);
+    if (!self) return;
+    Nan::HandleScope scope;
+    CallMethod(self->handle(), "ondrain", 0, NULL);
+  }
+
+  void InputStream::Closed(uv_handle_t* handle) {
+    delete reinterpret_cast<uv_async_t*>(handle);
+  }
+
+  NAN_MODULE_INIT(OutputStream::Init) {
+    v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
+    tpl->SetClassName(Nan::New("TidyOutputStream").ToLocalChecked());
+    tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+    Nan::SetPrototypeMethod(tpl, "resume", resume);
+
+    tpl = Instance::Keep(Instance::Current()->outputStreamTemplate, tpl);
+    Nan::Set(target, Nan::New("TidyOutputStream").ToLocalChecked(),
+             Nan::GetFunction(tpl).ToLocalChecked());
+  }
+
+  OutputStream* OutputStream::Unwrap(v8::Local<v8::Value> value) {
+    v8::Local<v8::FunctionTemplate> tpl =
+      Nan::New(Instance::Current()->outputStreamTemplate);
+    if (!tpl->HasInstance(value)) return NULL;
+    return Nan::ObjectWrap::Unwrap<OutputStream>(value.As<v8::Object>());
+  }
+
+  OutputStream::OutputStream(size_t chunkSize, size_t maxQueued)
+    : finished(false), discarding(false), paused(false), ended(false),
+      chunkSize(chunkSize), maxQueued(maxQueued)
+  {
+    tidyInitSink(&snk, this, putByte);
+    current.data = NULL;
+    current.size = 0;
+    uv_mutex_init(&mutex);
+    uv_cond_init(&cond);
+    async = new uv_async_t;
+    async->data = this;
+    uv_async_init(Nan::GetCurrentEventLoop(), async, Deliverable);
+    uv_unref(reinterpret_cast<uv_handle_t*>(async));
+  }
+
+  OutputStream::~OutputStream() {
+    if (current.data)
+      allocator.vtbl->free(&allocator, current.data);
+    for (std::deque<Chunk>::iterator i = queue.begin(), e = queue.end();
+         i != e; ++i)
+      allocator.vtbl->free(&allocator, i->data);
+    async->data = NULL;
+    uv_close(reinterpret_cast<uv_handle_t*>(async), Closed);
+    uv_cond_destroy(&cond);
+    uv_mutex_destroy(&mutex);
+  }
+
+  // arguments:
+  // 0 - optional size of the chunks handed to JavaScript
+  // 1 - optional number of chunks waiting before the worker blocks
+  // Each chunk gets passed to the ondata method of the object.
+  // If that returns false, delivery stops until resume gets called.
+  // Once all output has been delivered, the onend method gets called.
+  NAN_METHOD(OutputStream::New) {
+    if (!info.IsConstructCall()) {
+      Nan::ThrowTypeError("TidyOutputStream must be called with new");
+      return;
+    }
+    size_t chunkSize = 16 * 1024, maxQueued = 4;
+    if (info[0]->IsNumber())
+      chunkSize = Nan::To<uint32_t>(info[0]).FromJust();
+    if (info[1]->IsNumber())
+      maxQueued = Nan::To<uint32_t>(info[1]).FromJust();
+    if (chunkSize == 0 || maxQueued == 0) {
+      Nan::ThrowRangeError("TidyOutputStream limits must be positive");
+      return;
+    }
+    OutputStream* obj = new OutputStream(chunkSize, maxQueued);
+    obj->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+  }
+
+  NAN_METHOD(OutputStream::resume) {
+    OutputStream* self = Unwrap(info.Holder());
+    if (!self) {
+      Nan::ThrowTypeError("Not a valid TidyOutputStream object");
+      return;
+    }
+    if (!self->paused) return;
+    self->paused = false;
+    // Deliver from a fresh stack, since this is usually called
+    // from within some stream event handler
+    uv_async_send(self->async);
+  }
+
+  void TIDY_CALL OutputStream::putByte(void* data, byte bt) {
+    OutputStream* self = static_cast<OutputStream*>(data);
+    if (!self->current.data) {
+      self->current.data = static_cast<byte*>
+        (allocator.vtbl->alloc(&allocator, self->chunkSize));
+      if (!self->current.data)
+        allocator.vtbl->panic(&allocator, "Out of memory!");
+    }
+    self->current.data[self->current.size++] = bt;
+    if (self->current.size == self->chunkSize)
+      self->hand();
+  }
+
+  // Passes the current chunk on to the main thread,
+  // waiting while too many chunks are queued already.
+  void OutputStream::hand() {
+    uv_mutex_lock(&mutex);
+    while (queue.size() >= maxQueued && !discarding)
+      uv_cond_wait(&cond, &mutex);
+    if (discarding) {
+      uv_mutex_unlock(&mutex);
+      current.size = 0; // keep the buffer for the next chunk
+      return;
+    }
+    queue.push_back(current);
+    uv_mutex_unlock(&mutex);
+    uv_async_send(async);
+    current.data = NULL;
+    current.size = 0;
+  }
+
+  void OutputStream::discard() {
+    uv_mutex_lock(&mutex);
+    discarding = true;
+    uv_cond_signal(&cond);
+    uv_mutex_unlock(&mutex);
+  }
+
+  void OutputStream::finish() {
+    if (current.size)
+      hand();
+    uv_mutex_lock(&mutex);
+    finished = true;
+    uv_mutex_unlock(&mutex);
+    uv_async_send(async);
+  }
+
+  void OutputStream::Deliver() {
+    Nan::HandleScope scope;
+    v8::Local<v8::Object> obj = handle();
+    while (!paused) {
+      uv_mutex_lock(&mutex);
+      if (queue.empty()) {
+        bool done = finished;
+        uv_mutex_unlock(&mutex);
+        if (done && !ended) {
+          ended = true;
+          CallMethod(obj, "onend", 0, NULL);
+        }
+        return;
+      }
+      Chunk chunk = queue.front();
+      queue.pop_front();
+      uv_cond_signal(&cond);
+      uv_mutex_unlock(&mutex);
+      v8::Local<v8::Value> argv[1] = {
+        Nan::NewBuffer(b2c(chunk.data), chunk.size, FreeChunk, NULL)
+        .ToLocalChecked()
+      };
+      v8::Local<v8::Value> res = CallMethod(obj, "ondata", 1, argv);
+      if (!res.IsEmpty() && res->IsFalse())
+        paused = true;
+    }
+  }
+
+  void OutputStream::Deliverable(uv_async_t* handle) {
+    OutputStream* self = static_cast<OutputStream*>(handle->data);
+    if (self) self->Deliver();
+  }
+
+  void OutputStream::Closed(uv_handle_t* handle) {
+    delete reinterpret_cast<uv_async_t*>(handle);
+  }
+
+  void OutputStream::FreeChunk(char* data, void*) {
+    allocator.vtbl->free(&allocator, data);
+  }
+
+}
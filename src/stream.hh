@@ -0,0 +1,121 @@
+namespace node_libtidy {
+
+  // Input for tidyParseSource, fed chunk by chunk from JavaScript
+  // while a worker thread is already parsing what arrived so far.
+  // Chunks get released as soon as the parser has consumed them.
+  class InputStream : public Nan::ObjectWrap {
+  public:
+    static NAN_MODULE_INIT(Init);
+
+    // Returns NULL if the value is not an InputStream
+    static InputStream* Unwrap(v8::Local<v8::Value> value);
+
+    TidyInputSource* source() { return &src; }
+
+    // Ends the input, like calling end from JavaScript
+    void close();
+
+  private:
+    struct Chunk {
+      byte* data;
+      size_t size;
+    };
+
+    explicit InputStream(size_t highWaterMark);
+    ~InputStream();
+
+    // The following are called on the parsing thread
+    static int TIDY_CALL getByte(void* data);
+    static void TIDY_CALL ungetByte(void* data, byte bt);
+    static Bool TIDY_CALL isEOF(void* data);
+    bool next();
+
+    static void Drained(uv_async_t* handle);
+    static void Closed(uv_handle_t* handle);
+
+    TidyInputSource src;
+
+    // Only accessed by the parsing thread
+    Chunk current;
+    size_t pos;
+    std::vector<byte> pushedBack;
+
+    // Protected by the mutex
+    uv_mutex_t mutex;
+    uv_cond_t cond;
+    std::deque<Chunk> queue;
+    size_t queued;
+    bool ended;
+    bool wantDrain;
+
+    // Fixed at construction
+    size_t highWaterMark;
+    uv_async_t* async;
+
+    static NAN_METHOD(New);
+    static NAN_METHOD(push);
+    static NAN_METHOD(end);
+  };
+
+  // Output for tidySaveSink, handed to JavaScript in fixed-size chunks
+  // while a worker thread is still pretty-printing.
+  // The worker blocks while too many chunks are waiting for delivery.
+  class OutputStream : public Nan::ObjectWrap {
+  public:
+    static NAN_MODULE_INIT(Init);
+
+    // Returns NULL if the value is not an OutputStream
+    static OutputStream* Unwrap(v8::Local<v8::Value> value);
+
+    TidyOutputSink* sink() { return &snk; }
+
+    // Called on the worker thread once all output has been written
+    void finish();
+
+    // Drops all further output, so that the worker never blocks
+    void discard();
+
+  private:
+    struct Chunk {
+      byte* data;
+      size_t size;
+    };
+
+    OutputStream(size_t chunkSize, size_t maxQueued);
+    ~OutputStream();
+
+    // The following are called on the worker thread
+    static void TIDY_CALL putByte(void* data, byte bt);
+    void hand();
+
+    void Deliver();
+    static void Deliverable(uv_async_t* handle);
+    static void Closed(uv_handle_t* handle);
+    static void FreeChunk(char* data, void* hint);
+
+    TidyOutputSink snk;
+
+    // Only accessed by the worker thread
+    Chunk current;
+
+    // Protected by the mutex
+    uv_mutex_t mutex;
+    uv_cond_t cond;
+    std::deque<Chunk> queue;
+    bool finished;
+    bool discarding;
+
+    // Only accessed by the main thread
+    bool paused;
+    bool ended;
+
+    // Fixed at construction
+    size_t chunkSize;
+    size_t maxQueued;
+    uv_async_t* async;
+
+    static NAN_METHOD(New);
+    static NAN_METHOD(resume);
+  };
+
+}
@@ -0,0 +1,150 @@
+#include "node-libtidy.hh"
+
+#include <cstring>
+
+namespace node_libtidy {
+
+  namespace {
+
+    struct TypeName {
+      TidyNodeType type;
+      const char* name;
+    };
+
+    const TypeName typeNames[] = {
+      { TidyNode_Root, "Root" },
+      { TidyNode_DocType, "DocType" },
+      { TidyNode_Comment, "Comment" },
+      { TidyNode_ProcIns, "ProcIns" },
+      { TidyNode_Text, "Text" },
+      { TidyNode_Start, "Start" },
+      { TidyNode_End, "End" },
+      { TidyNode_StartEnd, "StartEnd" },
+      { TidyNode_CDATA, "CDATA" },
+      { TidyNode_Section, "Section" },
+      { TidyNode_Asp, "Asp" },
+      { TidyNode_Jste, "Jste" },
+      { TidyNode_Php, "Php" },
+      { TidyNode_XmlDecl, "XmlDecl" },
+    };
+
+    const size_t numTypes = sizeof(typeNames) / sizeof(typeNames[0]);
+
+  }
+
+  NAN_MODULE_INIT(Tree::Init) {
+    v8::Local<v8::Array> arr = Nan::New<v8::Array>();
+    for (size_t i = 0; i < numTypes; ++i)
+      Nan::Set(arr, typeNames[i].type,
+               Nan::New(typeNames[i].name).ToLocalChecked());
+    Nan::Set(target, Nan::New("nodeTypes").ToLocalChecked(), arr);
+  }
+
+  // Walks the tree in document order without recursion,
+  // since tidy doesn't limit the nesting depth.
+  Tree::Tree(TidyDoc doc) : doc(doc) {
+    offsets.push_back(0);
+    tidyBufInitWithAllocator(&value, &allocator);
+    TidyNode node = tidyGetRoot(doc);
+    int32_t cur = add(node, -1);
+    for (;;) {
+      TidyNode next = tidyGetChild(node);
+      if (next) {
+        cur = add(next, cur);
+        node = next;
+        continue;
+      }
+      while (node && !(next = tidyGetNext(node))) {
+        node = tidyGetParent(node);
+        cur = parents[cur];
+      }
+      if (!node) break;
+      cur = add(next, parents[cur]);
+      node = next;
+    }
+    tidyBufFree(&value);
+    lastChildren.clear();
+  }
+
+  int32_t Tree::add(TidyNode node, int32_t parent) {
+    int32_t index = types.size();
+    types.push_back(tidyNodeGetType(node));
+    tags.push_back(tidyNodeGetId(node));
+    parents.push_back(parent);
+    firstChildren.push_back(-1);
+    nextSiblings.push_back(-1);
+    lastChildren.push_back(-1);
+    if (parent >= 0) {
+      int32_t prev = lastChildren[parent];
+      if (prev < 0)
+        firstChildren[parent] = index;
+      else
+        nextSiblings[prev] = index;
+      lastChildren[parent] = index;
+    }
+    names.push_back(name(tidyNodeGetName(node)));
+    if (tidyNodeGetValue(doc, node, &value))
+      values.push_back(string(b2c(value.bp), value.size));
+    else
+      values.push_back(-1);
+    int32_t firstAttr = attrIds.size();
+    for (TidyAttr attr = tidyAttrFirst(node); attr; attr = tidyAttrNext(attr)) {
+      attrIds.push_back(tidyAttrGetId(attr));
+      attrNames.push_back(name(tidyAttrName(attr)));
+      ctmbstr val = tidyAttrValue(attr);
+      attrValues.push_back(val ? string(val, std::strlen(val)) : -1);
+    }
+    firstAttrs.push_back(firstAttr);
+    attrCounts.push_back(attrIds.size() - firstAttr);
+    lines.push_back(tidyNodeLine(node));
+    columns.push_back(tidyNodeColumn(node));
+    return index;
+  }
+
+  int32_t Tree::string(const char* data, size_t length) {
+    strings.append(data, length);
+    offsets.push_back(strings.size());
+    return offsets.size() - 2;
+  }
+
+  int32_t Tree::name(ctmbstr str) {
+    if (!str) return -1;
+    std::string key(str);
+    std::map<std::string, int32_t>::iterator i = nameIndex.find(key);
+    if (i != nameIndex.end()) return i->second;
+    int32_t index = string(key.data(), key.length());
+    nameIndex.insert(std::make_pair(key, index));
+    return index;
+  }
+
+  v8::Local<v8::Object> Tree::result() const {
+    Nan::EscapableHandleScope scope;
+    v8::Local<v8::Object> res = Nan::New<v8::Object>();
+    Nan::Set(res, Nan::New("type").ToLocalChecked(), NewInt32Array(types));
+    Nan::Set(res, Nan::New("tag").ToLocalChecked(), NewInt32Array(tags));
+    Nan::Set(res, Nan::New("parent").ToLocalChecked(), NewInt32Array(parents));
+    Nan::Set(res, Nan::New("firstChild").ToLocalChecked(),
+             NewInt32Array(firstChildren));
+    Nan::Set(res, Nan::New("nextSibling").ToLocalChecked(),
+             NewInt32Array(nextSiblings));
+    Nan::Set(res, Nan::New("name").ToLocalChecked(), NewInt32Array(names));
+    Nan::Set(res, Nan::New("value").ToLocalChecked(), NewInt32Array(values));
+    Nan::Set(res, Nan::New("firstAttr").ToLocalChecked(),
+             NewInt32Array(firstAttrs));
+    Nan::Set(res, Nan::New("attrCount").ToLocalChecked(),
+             NewInt32Array(attrCounts));
+    Nan::Set(res, Nan::New("line").ToLocalChecked(), NewInt32Array(lines));
+    Nan::Set(res, Nan::New("column").ToLocalChecked(), NewInt32Array(columns));
+    Nan::Set(res, Nan::New("attrId").ToLocalChecked(), NewInt32Array(attrIds));
+    Nan::Set(res, Nan::New("attrName").ToLocalChecked(),
+             NewInt32Array(attrNames));
+    Nan::Set(res, Nan::New("attrValue").ToLocalChecked(),
+             NewInt32Array(attrValues));
+    Nan::Set(res, Nan::New("strings").ToLocalChecked(),
+             Nan::CopyBuffer(strings.data(), strings.size()).ToLocalChecked());
+    Nan::Set(res, Nan::New("stringOffsets").ToLocalChecked(),
+             NewInt32Array(offsets));
+    return scope.Escape(res);
+  }
+
+}
@@ -0,0 +1,50 @@
+namespace node_libtidy {
+
+  // Flat representation of the document tree, built in a single walk.
+  // Nodes are numbered in document order, with the root as node 0,
+  // and described by parallel arrays indexed by node number.
+  // Attributes are numbered as well, those of each node being consecutive.
+  // All names and texts live in one shared string table;
+  // tag and attribute names are stored only once each.
+  class Tree {
+  public:
+    explicit Tree(TidyDoc doc);
+
+    v8::Local<v8::Object> result() const;
+
+    static NAN_MODULE_INIT(Init);
+
+  private:
+    int32_t add(TidyNode node, int32_t parent);
+    int32_t string(const char* data, size_t length);
+    int32_t name(ctmbstr str); // deduplicated, -1 for NULL
+
+    TidyDoc doc;
+    TidyBuffer value; // scratch space for tidyNodeGetValue
+
+    // Per node
+    std::vector<int32_t> types;
+    std::vector<int32_t> tags;
+    std::vector<int32_t> parents;
+    std::vector<int32_t> firstChildren;
+    std::vector<int32_t> nextSiblings;
+    std::vector<int32_t> names;
+    std::vector<int32_t> values;
+    std::vector<int32_t> firstAttrs;
+    std::vector<int32_t> attrCounts;
+    std::vector<int32_t> lines;
+    std::vector<int32_t> columns;
+    std::vector<int32_t> lastChildren; // only needed while linking
+
+    // Per attribute
+    std::vector<int32_t> attrIds;
+    std::vector<int32_t> attrNames;
+    std::vector<int32_t> attrValues;
+
+    // String i spans the bytes from offsets[i] to offsets[i + 1]
+    std::string strings;
+    std::vector<int32_t> offsets;
+    std::map<std::string, int32_t> nameIndex;
+  };
+
+}
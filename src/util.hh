@@ -41,6 +41,19 @@ namespace node_libtidy {
     return Nan::New<v8::String>(str.c_str(), str.length()).ToLocalChecked();
   }
 
+  // Copies the values, since the vector won't outlive the array.
+  // A copied buffer owns its ArrayBuffer, so the values are aligned.
+  inline v8::Local<v8::Int32Array>
+  NewInt32Array(const std::vector<int32_t>& values) {
+    Nan::EscapableHandleScope scope;
+    v8::Local<v8::Object> buf = Nan::CopyBuffer
+      (reinterpret_cast<const char*>(values.data()),
+       values.size() * sizeof(int32_t)).ToLocalChecked();
+    v8::Local<v8::Uint8Array> bytes = buf.As<v8::Uint8Array>();
+    return scope.Escape(v8::Int32Array::New
+      (bytes->Buffer(), bytes->ByteOffset(), values.size()));
+  }
+
   inline std::string trim(std::string str) {
     while (str.length() && str[str.length() - 1] == '\n')
       str.resize(str.length() - 1);
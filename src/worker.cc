@@ -1,66 +1,460 @@
 #include "node-libtidy.hh"
 
+#include <cstring>
+
 namespace node_libtidy {
 
-  TidyWorker::TidyWorker(Doc* doc,
-                         v8::Local<v8::Function> resolve,
-                         v8::Local<v8::Function> reject)
-    : Nan::AsyncWorker(NULL), doc(doc), resolve(resolve), reject(reject)
+  JobSettings::JobSettings(v8::Local<v8::Value> obj)
+    : priority(0), timeout(0), memoryLimit(0), cache(false),
+      hasSkipHash(false), skipHash(0)
+  {
+    if (!obj->IsObject()) return;
+    v8::Local<v8::Value> val =
+      Nan::Get(obj.As<v8::Object>(),
+               Nan::New("priority").ToLocalChecked()).ToLocalChecked();
+    if (!val->IsUndefined())
+      priority = Nan::To<int32_t>(val).FromJust();
+    val = Nan::Get(obj.As<v8::Object>(),
+                   Nan::New("timeout").ToLocalChecked()).ToLocalChecked();
+    if (!val->IsUndefined())
+      timeout = Nan::To<double>(val).FromJust();
+    if (!(timeout > 0)) // also catches NaN
+      timeout = 0;
+    val = Nan::Get(obj.As<v8::Object>(),
+                   Nan::New("memoryLimit").ToLocalChecked()).ToLocalChecked();
+    if (!val->IsUndefined())
+      memoryLimit = Nan::To<double>(val).FromJust();
+    if (!(memoryLimit > 0))
+      memoryLimit = 0;
+    val = Nan::Get(obj.As<v8::Object>(),
+                   Nan::New("cache").ToLocalChecked()).ToLocalChecked();
+    cache = Nan::To<bool>(val).FromJust();
+    val = Nan::Get(obj.As<v8::Object>(),
+                   Nan::New("skipHash").ToLocalChecked()).ToLocalChecked();
+    hasSkipHash = Cache::ParseHash(val, skipHash);
+  }
+
+  void Budget::start(double timeout, const DocAllocator* alloc) {
+    if (timeout > 0)
+      deadline = uv_hrtime() + static_cast<uint64_t>(timeout * 1e6);
+    this->alloc = alloc;
+  }
+
+  void Budget::abort() {
+    leave(Aborted);
+  }
+
+  Budget::State Budget::check() {
+    if (current() == Running && alloc && alloc->overLimit())
+      leave(OverLimit);
+    if (current() == Running && deadline && uv_hrtime() >= deadline)
+      leave(TimedOut);
+    return current();
+  }
+
+  void Budget::leave(State reason) {
+    int expected = Running;
+    state.compare_exchange_strong(expected, reason,
+                                  std::memory_order_relaxed);
+  }
+
+  TidyInputSource* Budget::guard(TidyInputSource* inner) {
+    this->inner = inner;
+    src.getByte = getByte;
+    src.ungetByte = ungetByte;
+    src.eof = isEOF;
+    src.sourceData = this;
+    return &src;
+  }
+
+  int TIDY_CALL Budget::getByte(void* data) {
+    Budget* self = static_cast<Budget*>(data);
+    if (self->poll() != Running) return EndOfStream;
+    return self->inner->getByte(self->inner->sourceData);
+  }
+
+  void TIDY_CALL Budget::ungetByte(void* data, byte bt) {
+    Budget* self = static_cast<Budget*>(data);
+    self->inner->ungetByte(self->inner->sourceData, bt);
+  }
+
+  Bool TIDY_CALL Budget::isEOF(void* data) {
+    Budget* self = static_cast<Budget*>(data);
+    if (self->current() != Running) return yes;
+    return self->inner->eof(self->inner->sourceData);
+  }
+
+  TidyJob::TidyJob(Doc* doc)
+    : doc(doc), origin(NULL), stream(NULL), sink(NULL),
+      timeout(0), memoryLimit(0), output(&outputAlloc)
   {
-    doc->Lock();
+    shouldExtract = false;
+    shouldSplitFragments = false;
+    shouldDropTree = false;
+    cacheable = false;
+    wroteFile = false;
+    unchangedFile = false;
+    hasSkipHash = false;
+    skipped = false;
+    hashedInput = false;
+    doc->Lock(this);
     tidyBufInitWithAllocator(&input, &allocator);
+    std::memset(samples, 0, sizeof(samples));
+  }
+
+  TidyJob::~TidyJob() {
+    if (origin)
+      origin->spawned.erase(this);
   }
 
-  void TidyWorker::setInput(const char* data, size_t length) {
+  void TidyJob::setInput(const char* data, size_t length) {
     tidyBufAttach(&input, c2b(const_cast<char*>(data)), length);
   }
 
-  void TidyWorker::Execute() {
+  void TidyJob::setInput(InputStream* stream) {
+    this->stream = stream;
+  }
+
+  void TidyJob::setOutput(OutputStream* sink) {
+    this->sink = sink;
+  }
+
+  void TidyJob::setInputFile(const std::string& path) {
+    inputFile = path;
+  }
+
+  void TidyJob::setOutputFile(const std::string& path) {
+    outputFile = path;
+  }
+
+  void TidyJob::setLimits(const JobSettings& settings) {
+    timeout = settings.timeout;
+    memoryLimit = settings.memoryLimit;
+  }
+
+  void TidyJob::setOrigin(Doc* origin) {
+    this->origin = origin;
+    origin->spawned.insert(this);
+  }
+
+  void TidyJob::skipIfHash(uint64_t hash) {
+    hasSkipHash = true;
+    skipHash = hash;
+  }
+
+  // Only plain tidyBuffer jobs qualify, and only without collecting
+  // messages, since the cache keeps nothing but output and error log.
+  v8::Local<v8::Object> TidyJob::lookup(const JobSettings& settings) {
+    if (!settings.cache || !Cache::IsEnabled() || stream || sink ||
+        !input.bp || shouldExtract || doc->messages.isEnabled() ||
+        !(shouldCleanAndRepair && shouldRunDiagnostics && shouldSaveToBuffer))
+      return v8::Local<v8::Object>();
+    cacheKey = Cache::MakeKey(doc->doc, b2c(input.bp), input.size);
+    Nan::EscapableHandleScope scope;
+    v8::Local<v8::Object> res =
+      Cache::Lookup(cacheKey, b2c(input.bp), input.size);
+    if (res.IsEmpty()) {
+      cacheable = true;
+      return res;
+    }
+    doc->Unlock();
+    return scope.Escape(res);
+  }
+
+  void TidyJob::Abort() {
+    budget.abort();
+    if (stream) // the parser might be waiting for more input
+      stream->close();
+    if (sink) // or the printer for JavaScript to take the output
+      sink->discard();
+  }
+
+  v8::Local<v8::Value> TidyJob::RunSync(const JobSettings& settings) {
+    Nan::EscapableHandleScope scope;
+    v8::Local<v8::Value> res = lookup(settings);
+    bool failed = false;
+    if (res.IsEmpty()) {
+      Run();
+      if (!Complete(res, failed)) // execution got terminated
+        return scope.Escape(v8::Local<v8::Value>());
+    }
+    if (failed) {
+      v8::Isolate::GetCurrent()->ThrowException(res);
+      return scope.Escape(v8::Local<v8::Value>());
+    }
+    return scope.Escape(res);
+  }
+
+  bool TidyJob::proceed() {
+    return rc >= 0 && !fileError.failed() && !skipped &&
+      budget.check() == Budget::Running;
+  }
+
+  void TidyJob::Run() {
     WorkerSentinel sentinel(parent);
     rc = 0;
-    if (rc >= 0 && input.bp) {
-      lastFunction = "tidyParseString";
-      rc = tidyParseBuffer(doc->doc, &input);
+    doc->alloc.setLimit(memoryLimit < SIZE_MAX ? size_t(memoryLimit) : 0);
+    budget.start(timeout, &doc->alloc);
+    if (proceed() && stream) {
+      Metrics::Timer timer(samples[Metrics::Parse], doc->alloc);
+      lastFunction = "tidyParseSource";
+      doc->BeforeParse();
+      rc = tidyParseSource(doc->doc, budget.guard(stream->source()));
+    }
+    if (proceed() && !inputFile.empty()) {
+      Metrics::Timer timer(samples[Metrics::Parse], doc->alloc);
+      // Read natively, like an attached Node buffer it is never copied
+      if (content.read(inputFile, fileError)) {
+        if (!outputFile.empty()) {
+          Cache::Hasher hasher;
+          hasher.update(content.data(), content.length());
+          inputHash = hasher.digest();
+          hashedInput = true;
+          skipped = hasSkipHash && inputHash == skipHash;
+        }
+        if (!skipped) {
+          lastFunction = "tidyParseSource";
+          doc->BeforeParse();
+          tidyBufAttach(&input, c2b(const_cast<char*>(content.data())),
+                        content.length());
+          TidyInputSource source;
+          tidyInitInputBuffer(&source, &input);
+          rc = tidyParseSource(doc->doc, budget.guard(&source));
+          tidyBufDetach(&input);
+        }
+        // Keep the content while the output might get compared with it
+        if (outputFile != inputFile)
+          content.close();
+      }
+    } else if (proceed() && input.bp) {
+      Metrics::Timer timer(samples[Metrics::Parse], doc->alloc);
+      lastFunction = "tidyParseSource";
+      doc->BeforeParse();
+      TidyInputSource source;
+      tidyInitInputBuffer(&source, &input);
+      rc = tidyParseSource(doc->doc, budget.guard(&source));
     }
-    if (rc >= 0 && shouldCleanAndRepair) {
+    if (proceed() && shouldCleanAndRepair) {
+      Metrics::Timer timer(samples[Metrics::CleanAndRepair], doc->alloc);
       lastFunction = "tidyCleanAndRepair";
       rc = tidyCleanAndRepair(doc->doc);
     }
-    if (rc >= 0 && shouldRunDiagnostics) {
+    if (proceed() && shouldRunDiagnostics) {
+      Metrics::Timer timer(samples[Metrics::RunDiagnostics], doc->alloc);
       lastFunction = "tidyRunDiagnostics";
       rc = tidyRunDiagnostics(doc->doc);
     }
-    if (rc >= 0 && shouldSaveToBuffer) {
+    if (proceed() && shouldExtract) {
+      Metrics::Timer timer(samples[Metrics::Extraction], doc->alloc);
+      extraction.run(doc->doc);
+    }
+    if (proceed() && shouldSaveToBuffer) {
+      Metrics::Timer timer(samples[Metrics::Save], doc->alloc, &outputAlloc);
       lastFunction = "tidySaveBuffer";
       rc = tidySaveBuffer(doc->doc, output);
     }
+    if (proceed() && sink) {
+      Metrics::Timer timer(samples[Metrics::Save], doc->alloc);
+      lastFunction = "tidySaveSink";
+      rc = tidySaveSink(doc->doc, sink->sink());
+    }
+    if (sink)
+      sink->finish();
+    if (proceed() && shouldSplitFragments) {
+      if (shouldSaveToBuffer)
+        fragments.split(doc->doc, output, doc->messages);
+      tidyFragments();
+    }
+    if (proceed() && !outputFile.empty()) {
+      Metrics::Timer timer(samples[Metrics::Save], doc->alloc);
+      lastFunction = "tidySaveSink";
+      FileSink file(outputFile);
+      if (outputFile == inputFile)
+        file.compareWith(content.data(), content.length());
+      rc = tidySaveSink(doc->doc, file.sink());
+      file.finish(fileError);
+      content.close();
+      if (proceed())
+        file.commit(fileError);
+      wroteFile = !file.isEmpty();
+      unchangedFile = file.isUnchanged();
+      outputHash = file.hash();
+    }
+    content.close();
+    // Don't keep the partial tree around, since it is large by definition.
+    // In an arena this wouldn't free anything before the next parse.
+    if (shouldDropTree ||
+        (budget.current() == Budget::OverLimit && !doc->isArena()))
+      doc->DropTree();
   }
 
-  void TidyWorker::WorkComplete() {
+  // Fragments which couldn't be split from the combined document
+  // get tidied one after the other, reusing the document.
+  void TidyJob::tidyFragments() {
+    for (size_t i = 0; i < fragments.count() && proceed(); ++i) {
+      if (fragments.combined(i)) continue;
+      Buf out(&outputAlloc);
+      doc->BeforeParse();
+      doc->messages.reset();
+      {
+        Metrics::Timer timer(samples[Metrics::Parse], doc->alloc);
+        lastFunction = "tidyParseSource";
+        std::string text = fragments.alone(doc->doc, i);
+        tidyBufAttach(&input, c2b(const_cast<char*>(text.data())),
+                      text.length());
+        TidyInputSource source;
+        tidyInitInputBuffer(&source, &input);
+        rc = tidyParseSource(doc->doc, budget.guard(&source));
+        tidyBufDetach(&input);
+      }
+      if (proceed()) {
+        Metrics::Timer timer(samples[Metrics::CleanAndRepair], doc->alloc);
+        lastFunction = "tidyCleanAndRepair";
+        rc = tidyCleanAndRepair(doc->doc);
+      }
+      if (proceed()) {
+        Metrics::Timer timer(samples[Metrics::RunDiagnostics], doc->alloc);
+        lastFunction = "tidyRunDiagnostics";
+        rc = tidyRunDiagnostics(doc->doc);
+      }
+      if (proceed()) {
+        Metrics::Timer timer(samples[Metrics::Save], doc->alloc,
+                             &outputAlloc);
+        lastFunction = "tidySaveBuffer";
+        rc = tidySaveBuffer(doc->doc, out);
+      }
+      if (proceed())
+        fragments.keep(doc->doc, i, out, doc->messages);
+    }
+  }
+
+  bool TidyJob::Complete(v8::Local<v8::Value>& res, bool& failed) {
     doc->Unlock();
-    v8::Local<v8::Value> args[1];
-    Nan::HandleScope scope;
+    Metrics::Record(samples);
+    failed = true;
+    Budget::State state = budget.current();
+    if (state != Budget::Running) {
+      const char* msg;
+      const char* code;
+      switch (state) {
+      case Budget::Aborted:
+        msg = "Tidy job was aborted";
+        code = "ABORT_ERR";
+        break;
+      case Budget::TimedOut:
+        msg = "Tidy job exceeded its time budget";
+        code = "ETIMEDOUT";
+        break;
+      default:
+        msg = "Tidy job failed: memory limit exceeded";
+        code = "ENOMEM";
+        break;
+      }
+      res = Nan::Error(msg);
+      Nan::Set(res.As<v8::Object>(), Nan::New("code").ToLocalChecked(),
+               Nan::New(code).ToLocalChecked());
+      return true;
+    }
+    if (fileError.failed()) {
+      res = fileError.exception();
+      return true;
+    }
     {
       Nan::TryCatch tryCatch;
       doc->CheckResult(rc, lastFunction);
       if (tryCatch.HasCaught()) {
-        if (!tryCatch.CanContinue()) return;
-        args[0] = tryCatch.Exception();
-        reject(1, args);
-        return;
+        if (!tryCatch.CanContinue()) return false;
+        res = tryCatch.Exception();
+        return true;
       }
     }
-    v8::Local<v8::Object> res = Nan::New<v8::Object>();
+    failed = false;
+    if (shouldSplitFragments) {
+      res = fragments.result();
+      return true;
+    }
+    v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+    res = obj;
+    v8::Local<v8::Value> out = Nan::Null();
     if (shouldSaveToBuffer) {
-      v8::Local<v8::Value> out = Nan::Null();
       if (!output.isEmpty())
         out = output.buffer().ToLocalChecked();
-      Nan::Set(res, Nan::New("output").ToLocalChecked(), out);
+      Nan::Set(obj, Nan::New("output").ToLocalChecked(), out);
     }
     v8::Local<v8::Value> err = doc->err.string().ToLocalChecked();
-    Nan::Set(res, Nan::New("errlog").ToLocalChecked(), err);
-    args[0] = res;
+    Nan::Set(obj, Nan::New("errlog").ToLocalChecked(), err);
+    if (cacheable)
+      Cache::Store(cacheKey, b2c(input.bp), input.size, out, err);
+    if (!outputFile.empty()) {
+      v8::Local<v8::Value> name = Nan::Null();
+      if (wroteFile || unchangedFile || skipped)
+        name = NewString(outputFile);
+      Nan::Set(obj, Nan::New("outputName").ToLocalChecked(), name);
+      if (skipped)
+        Nan::Set(obj, Nan::New("skipped").ToLocalChecked(), Nan::True());
+      if (unchangedFile)
+        Nan::Set(obj, Nan::New("unchanged").ToLocalChecked(), Nan::True());
+      if (hashedInput)
+        Nan::Set(obj, Nan::New("inputHash").ToLocalChecked(),
+                 Cache::HashString(inputHash));
+      if (wroteFile || unchangedFile)
+        Nan::Set(obj, Nan::New("outputHash").ToLocalChecked(),
+                 Cache::HashString(outputHash));
+    }
+    if (doc->messages.isEnabled())
+      Nan::Set(obj, Nan::New("messages").ToLocalChecked(),
+               doc->messages.result());
+    if (shouldExtract)
+      Nan::Set(obj, Nan::New("extracted").ToLocalChecked(),
+               extraction.result());
+    Nan::Set(obj, Nan::New("metrics").ToLocalChecked(),
+             Metrics::Result(samples));
+    return true;
+  }
+
+  TidyWorker::TidyWorker(Doc* doc,
+                         v8::Local<v8::Function> resolve,
+                         v8::Local<v8::Function> reject)
+    : Nan::AsyncWorker(NULL), TidyJob(doc), resolve(resolve), reject(reject)
+  {
+  }
+
+  TidyWorker::TidyWorker(Doc* doc)
+    : Nan::AsyncWorker(NULL), TidyJob(doc)
+  {
+  }
+
+  bool TidyWorker::fromCache(const JobSettings& settings) {
+    Nan::HandleScope scope;
+    v8::Local<v8::Object> res = lookup(settings);
+    if (res.IsEmpty()) return false;
+    Resolve(res);
+    return true;
+  }
+
+  void TidyWorker::Execute() {
+    Run();
+  }
+
+  void TidyWorker::WorkComplete() {
+    Nan::HandleScope scope;
+    v8::Local<v8::Value> res;
+    bool failed;
+    if (!Complete(res, failed)) return;
+    if (failed)
+      Reject(res);
+    else
+      Resolve(res);
+  }
+
+  void TidyWorker::Resolve(v8::Local<v8::Value> res) {
+    v8::Local<v8::Value> args[1] = { res };
     resolve(1, args);
   }
 
+  void TidyWorker::Reject(v8::Local<v8::Value> err) {
+    v8::Local<v8::Value> args[1] = { err };
+    reject(1, args);
+  }
+
 }
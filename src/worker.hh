@@ -1,25 +1,189 @@
 namespace node_libtidy {
 
-  class TidyWorker : public Nan::AsyncWorker {
+  // Settings which apply to a single asynchroneous job.
+  // They are read from an optional object passed from JavaScript,
+  // usually the TidyDoc itself.
+  struct JobSettings {
+    explicit JobSettings(v8::Local<v8::Value> obj);
+    int priority;
+    double timeout; // milliseconds, 0 for no limit
+    double memoryLimit; // bytes held by the document, 0 for no limit
+    bool cache; // whether the result cache may answer the job
+    // Hash of an input file known to need no tidying, see skipIfHash
+    bool hasSkipHash;
+    uint64_t skipHash;
+  };
+
+  // Limits on how long a single job may keep its thread busy
+  // and how much memory its document may use.
+  // The job may get aborted from the main thread at any time,
+  // and runs against a deadline once it got started.
+  // Both get checked between the phases of the job
+  // and while tidy reads its input, which then ends prematurely.
+  class Budget {
   public:
-    TidyWorker(Doc* doc,
-               v8::Local<v8::Function> resove,
-               v8::Local<v8::Function> reject);
+    enum State { Running, Aborted, TimedOut, OverLimit };
+
+    Budget() : deadline(0), alloc(NULL), state(Running), polls(0) { }
+
+    // Called on the worker thread when the job starts
+    void start(double timeout, const DocAllocator* alloc);
+
+    // Called on the main thread
+    void abort();
+
+    // Updates the state if the deadline has passed
+    State check();
+
+    State current() const {
+      return static_cast<State>(state.load(std::memory_order_relaxed));
+    }
+
+    // Cheaper version of check, for every byte of input
+    State poll() {
+      if (++polls % 4096 == 0 || (alloc && alloc->overLimit()))
+        return check();
+      return current();
+    }
+
+    // Wraps an input source so that it reports its end
+    // once the budget is exhausted
+    TidyInputSource* guard(TidyInputSource* inner);
+
+  private:
+    static int TIDY_CALL getByte(void* data);
+    static void TIDY_CALL ungetByte(void* data, byte bt);
+    static Bool TIDY_CALL isEOF(void* data);
+
+    // Only the first reason to stop sticks, from whichever thread
+    void leave(State reason);
+
+    uint64_t deadline; // uv_hrtime, 0 for no limit
+    const DocAllocator* alloc; // whose limit to watch, if any
+    // Written by the main thread as well as the worker thread.
+    // Nothing else gets published through it, so relaxed order suffices.
+    std::atomic<int> state;
+    unsigned polls;
+    TidyInputSource src;
+    TidyInputSource* inner;
+  };
+
+  // A tidy job, apart from how its result gets delivered.
+  // Runs on the calling thread for synchroneous use,
+  // or on a thread of the pool as part of a TidyWorker.
+  class TidyJob {
+  public:
+    explicit TidyJob(Doc* doc);
+    ~TidyJob();
     void setInput(const char* data, size_t length);
-    void Execute();
-    void WorkComplete();
+    void setInput(InputStream* stream);
+    void setOutput(OutputStream* sink);
+    // Files get opened on the thread running the job
+    void setInputFile(const std::string& path);
+    void setOutputFile(const std::string& path);
+    void setLimits(const JobSettings& settings);
+    // A file to file job whose input file has this hash
+    // resolves as skipped without parsing or writing anything
+    void skipIfHash(uint64_t hash);
+    // For jobs on a copy of a document, which abort along with it
+    void setOrigin(Doc* origin);
+
+    // Called once the job is set up, instead of running it right away.
+    // If the result of the same input and options is cached,
+    // unlocks the document and returns the result.
+    // Otherwise the result will get cached once the job is done.
+    v8::Local<v8::Object> lookup(const JobSettings& settings);
+
+    // Called on the thread which set up the job, while queued or running
+    void Abort();
+
+    // Runs the whole job on the calling thread,
+    // for documents too small to be worth a trip to the pool.
+    // Returns the result, or an empty handle after throwing the error
+    // the job would have been rejected with.
+    v8::Local<v8::Value> RunSync(const JobSettings& settings);
+
+    // Runs all the phases, possibly on another thread
+    void Run();
+
+    // Called on the thread which set up the job, inside a handle scope.
+    // Returns false if execution got terminated, otherwise sets res
+    // to the result, or to the error if failed.
+    bool Complete(v8::Local<v8::Value>& res, bool& failed);
 
     bool shouldCleanAndRepair;
     bool shouldRunDiagnostics;
     bool shouldSaveToBuffer;
+    bool shouldExtract;
+    Extract extraction;
+    // Whether the input consists of fragments, see Fragments.
+    // Unless they can be tidied as one document, the input is not set,
+    // and only the fragments tidied on their own make up the result.
+    bool shouldSplitFragments;
+    Fragments fragments;
+    // Whether to drop the tree once done, for documents kept idle
+    bool shouldDropTree;
+
+  protected:
+    Doc* doc;
+    Budget budget;
 
   private:
+    bool proceed();
+    void tidyFragments();
+
     WorkerParent parent;
-    Doc* doc;
+    Doc* origin;
     TidyBuffer input;
+    InputStream* stream;
+    OutputStream* sink;
+    std::string inputFile;
+    std::string outputFile;
+    FileContent content;
+    FileError fileError;
+    bool wroteFile;
+    bool unchangedFile; // output equal to the input it would replace
+    bool hasSkipHash;
+    uint64_t skipHash;
+    bool skipped;
+    bool hashedInput;
+    uint64_t inputHash;
+    uint64_t outputHash;
+    double timeout;
+    double memoryLimit;
+    Metrics::Sample samples[Metrics::NumPhases];
+    bool cacheable;
+    Cache::Key cacheKey;
+    CountingAllocator outputAlloc; // counts the output for the metrics
     Buf output;
     int rc;
     const char* lastFunction;
+
+    friend class Doc;
+  };
+
+  class TidyWorker : public Nan::AsyncWorker, public TidyJob {
+  public:
+    TidyWorker(Doc* doc,
+               v8::Local<v8::Function> resove,
+               v8::Local<v8::Function> reject);
+    // Without callbacks, for derived classes
+    // which deliver their result elsewhere
+    explicit TidyWorker(Doc* doc);
+
+    // Called once the job is set up, instead of queueing it right away.
+    // If the result is cached, the job gets resolved with it,
+    // and the caller must delete the worker instead of queueing it.
+    bool fromCache(const JobSettings& settings);
+
+    void Execute();
+    void WorkComplete();
+
+  protected:
+    virtual void Resolve(v8::Local<v8::Value> res);
+    virtual void Reject(v8::Local<v8::Value> err);
+
+  private:
     Nan::Callback resolve;
     Nan::Callback reject;
   };
@@ -0,0 +1,85 @@
+"use strict";
+
+var fs = require("fs");
+var os = require("os");
+var path = require("path");
+var chai = require("chai");
+var expect = chai.expect;
+var libtidy = require("../");
+var TidyDoc = libtidy.TidyDoc;
+
+describe("Result cache:", function() {
+
+  var testDoc1 = Buffer('<!DOCTYPE html>\n<html><head></head>\n' +
+                        '<body><p>foo</p></body></html>');
+
+  beforeEach(function() {
+    libtidy.configureCache({maxBytes: 1 << 20, file: null, clear: true});
+  });
+
+  after(function() {
+    libtidy.configureCache({maxBytes: 0, file: null});
+  });
+
+  it("is disabled by default for documents", function() {
+    return TidyDoc().tidyBuffer(testDoc1).then(function() {
+      expect(libtidy.cacheStats().entries).to.equal(0);
+    });
+  });
+
+  it("answers repeated inputs without running libtidy", function() {
+    var first;
+    return libtidy.tidyBuffer(testDoc1).then(function(res) {
+      expect(res).not.to.have.property("cached");
+      first = res;
+      return libtidy.tidyBuffer(Buffer.from(testDoc1));
+    }).then(function(res) {
+      expect(res.cached).to.be.true;
+      expect(res.output.toString()).to.equal(first.output.toString());
+      expect(res.errlog).to.equal(first.errlog);
+      expect(res.metrics).to.deep.equal({});
+      var stats = libtidy.cacheStats();
+      expect(stats.entries).to.equal(1);
+      expect(stats.hits).to.equal(1);
+      expect(stats.misses).to.equal(1);
+    });
+  });
+
+  it("distinguishes options", function() {
+    return libtidy.tidyBuffer(testDoc1).then(function() {
+      return libtidy.tidyBuffer(testDoc1, {show_body_only: true});
+    }).then(function(res) {
+      expect(res).not.to.have.property("cached");
+      expect(res.output.toString()).to.equal("<p>foo</p>\n");
+      expect(libtidy.cacheStats().entries).to.equal(2);
+    });
+  });
+
+  it("stays within its budget", function() {
+    libtidy.configureCache({maxBytes: 1000});
+    var docs = [];
+    for (var i = 0; i < 20; ++i)
+      docs.push("<p>" + i);
+    return libtidy.tidyBatch(docs).then(function() {
+      var stats = libtidy.cacheStats();
+      expect(stats.bytes).to.be.at.most(1000);
+      expect(stats.entries).to.be.above(0).and.below(20);
+    });
+  });
+
+  it("survives in its file", function() {
+    var file = path.join(os.tmpdir(), "libtidy-cache-test-" + process.pid);
+    libtidy.configureCache({file: file});
+    return libtidy.tidyBuffer(testDoc1).then(function() {
+      expect(libtidy.flushCache()).to.be.true;
+      libtidy.configureCache({file: null, clear: true});
+      libtidy.configureCache({file: file});
+      fs.unlinkSync(file);
+      expect(libtidy.cacheStats().entries).to.equal(1);
+      return libtidy.tidyBuffer(testDoc1);
+    }).then(function(res) {
+      expect(res.cached).to.be.true;
+    });
+  });
+
+});
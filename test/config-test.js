@@ -0,0 +1,133 @@
+"use strict";
+
+var chai = require("chai");
+var expect = chai.expect;
+var libtidy = require("../");
+var TidyDoc = libtidy.TidyDoc;
+var TidyConfig = libtidy.TidyConfig;
+
+describe("TidyConfig:", function() {
+
+  var testDoc1 = Buffer('<!DOCTYPE html>\n<html><head></head>\n' +
+                        '<body><p>foo</p></body></html>');
+
+  it("resolves options in any naming scheme", function() {
+    var config = new TidyConfig({
+      show_body_only: true,
+      "indent-spaces": 3,
+      IndentAttributes: "yes",
+    });
+    expect(config.optGet("show-body-only")).to.equal(true);
+    expect(config.optGet("indent_spaces")).to.equal(3);
+    expect(config.optGet("indent-attributes")).to.equal(true);
+  });
+
+  it("can be called without new", function() {
+    expect(TidyConfig({indent: "auto"}).optGet("indent")).to.equal("auto");
+  });
+
+  it("rejects unknown options", function() {
+    expect(() => new TidyConfig({no_such_option: 1}))
+      .to.throw(/Option 'no-such-option' unknown/);
+  });
+
+  it("rejects invalid values", function() {
+    expect(() => new TidyConfig({indent: "sideways"}))
+      .to.throw(/Failed to set option 'indent'/);
+  });
+
+  it("gets applied to a document", function() {
+    var doc = TidyDoc();
+    doc.applyConfig(new TidyConfig({show_body_only: true}));
+    expect(doc.optGet("show-body-only")).to.equal(true);
+    doc.parseBufferSync(testDoc1);
+    expect(doc.saveBufferSync().toString()).to.equal("<p>foo</p>\n");
+  });
+
+  it("gets applied by assigning to options", function() {
+    var doc = TidyDoc();
+    doc.options = new TidyConfig({show_body_only: true});
+    expect(doc.optGet("show-body-only")).to.equal(true);
+  });
+
+  it("is accepted by the high-level functions", function() {
+    var config = libtidy.createConfig({show_body_only: true});
+    expect(config.optGet("newline")).to.equal("LF");
+    return Promise.all([
+      libtidy.tidyBuffer(testDoc1, config),
+      libtidy.tidyBatch([testDoc1, testDoc1], config),
+    ]).then(function(res) {
+      expect(res[0].output.toString()).to.equal("<p>foo</p>\n");
+      expect(res[1][1].output.toString()).to.equal("<p>foo</p>\n");
+    });
+  });
+
+  describe("document pool:", function() {
+
+    it("reuses documents", function() {
+      var config = new TidyConfig({show_body_only: true});
+      expect(config.poolSize).to.equal(8);
+      expect(config.idle).to.equal(0);
+      return config.tidyBuffer(testDoc1).then(function(res) {
+        expect(res.output.toString()).to.equal("<p>foo</p>\n");
+        return new Promise(resolve => setImmediate(resolve));
+      }).then(function() {
+        expect(config.idle).to.equal(1);
+        return config.tidyBuffer(Buffer("<p>bar"));
+      }).then(function(res) {
+        expect(res.output.toString()).to.equal("<p>bar</p>\n");
+        expect(res.errlog).to.match(/missing <!DOCTYPE>/);
+      });
+    });
+
+    it("tidies synchronously", function() {
+      var config = new TidyConfig({show_body_only: true});
+      var res = config.tidyBufferSync(testDoc1);
+      expect(res.output.toString()).to.equal("<p>foo</p>\n");
+      expect(config.idle).to.equal(1);
+      res = libtidy.tidyBufferSync("<p>bar", config);
+      expect(res.output.toString()).to.equal("<p>bar</p>\n");
+      expect(config.idle).to.equal(1);
+    });
+
+    it("rejects jobs with a signal", function() {
+      var config = new TidyConfig();
+      config.signal = {
+        aborted: false,
+        addEventListener: function() {},
+        removeEventListener: function() {},
+      };
+      return config.tidyBuffer(testDoc1).then(function() {
+        throw Error("Signal should have been rejected");
+      }, function(err) {
+        expect(err).to.be.an.instanceof(TypeError);
+        expect(err.message).to.match(/signal/);
+      });
+    });
+
+    it("keeps at most poolSize documents", function() {
+      var config = new TidyConfig();
+      config.poolSize = 2;
+      var jobs = [];
+      for (var i = 0; i < 5; ++i)
+        jobs.push(config.tidyBuffer(testDoc1));
+      return Promise.all(jobs).then(function() {
+        return new Promise(resolve => setImmediate(resolve));
+      }).then(function() {
+        expect(config.idle).to.equal(2);
+        config.poolSize = 0;
+        expect(config.idle).to.equal(0);
+      });
+    });
+
+    it("serves the compat interface", function(done) {
+      var config = new TidyConfig({show_body_only: true});
+      libtidy.compat.htmltidy.tidy(testDoc1, config, function(err, output) {
+        expect(output).to.equal("<p>foo</p>\n");
+        done();
+      });
+    });
+
+  });
+
+});
@@ -3,6 +3,10 @@
 var chai = require("chai");
 chai.use(require("chai-subset"));
 var expect = chai.expect;
+var stream = require("stream");
+var fs = require("fs");
+var os = require("os");
+var path = require("path");
 var libtidy = require("../");
 var TidyDoc = libtidy.TidyDoc;
 
@@ -27,6 +31,22 @@ describe("TidyDoc:", function() {
       expect(doc.optGet("input-xml")).equal(false);
     });
 
+    it("with arena allocator", function() {
+      var doc = new TidyDoc({arena: true});
+      doc.optSet("show-body-only", true);
+      doc.parseBufferSync(testDoc1);
+      doc.cleanAndRepairSync();
+      var first = doc.saveBufferSync().toString();
+      expect(first).to.equal("<p>foo</p>\n");
+      // parsing again starts over with a fresh arena
+      doc.parseBufferSync(testDoc1);
+      doc.cleanAndRepairSync();
+      expect(doc.saveBufferSync().toString()).to.equal(first);
+      return doc.tidyBuffer(testDoc2).then(function(res) {
+        expect(res.errlog).to.match(/2 errors/);
+      });
+    });
+
   });
 
   describe("basic synchroneous operation:", function() {
@@ -74,6 +94,16 @@ describe("TidyDoc:", function() {
       expect(res.toString()).to.match(/<title>.*<\/title>/);
     });
 
+    it("save to independent buffers", function() {
+      var doc = new TidyDoc();
+      doc.parseBufferSync(testDoc1);
+      var res1 = doc.saveBufferSync();
+      var res2 = doc.saveBufferSync();
+      expect(res2.toString()).to.equal(res1.toString());
+      res1.fill(0x20);
+      expect(res2.toString()).to.match(/<title>.*<\/title>/);
+    });
+
     it("report errors in diagnostics", function() {
       var messages =
           'Info: Document content looks like HTML5\n' +
@@ -112,6 +142,48 @@ describe("TidyDoc:", function() {
       expect(res).to.have.length.above(100);
     });
 
+    it("all in one call", function() {
+      var doc = new TidyDoc();
+      var res = doc.tidyBufferSync(testDoc1);
+      expect(res.output.toString()).to.match(/<title>.*<\/title>/);
+      expect(res.errlog).to.match(/inserting missing/);
+      expect(res.metrics).to.have.all.keys(
+        "parse", "cleanAndRepair", "runDiagnostics", "save");
+      res = doc.tidyBufferSync(testDoc2);
+      expect(res.output).to.be.null;
+      expect(res.errlog).to.match(/Tidy found 5 warnings and 2 errors/);
+      expect(() => doc.tidyBufferSync("foo")).to.throw(TypeError);
+    });
+
+    it("export the tree", function() {
+      var doc = new TidyDoc();
+      doc.parseBufferSync(Buffer('<p class="x" hidden>foo<!--bar--></p>'));
+      doc.cleanAndRepairSync();
+      var tree = doc.getTree();
+      var str = i => libtidy.treeString(tree, i);
+      expect(libtidy.nodeTypes[tree.type[0]]).to.equal("Root");
+      expect(tree.parent[0]).to.equal(-1);
+      var names = [];
+      for (var i = 0; i < tree.type.length; ++i)
+        names.push(str(tree.name[i]));
+      var p = names.indexOf("p");
+      expect(p).to.be.above(0);
+      expect(names[tree.parent[p]]).to.equal("body");
+      expect(tree.attrCount[p]).to.equal(2);
+      var a = tree.firstAttr[p];
+      expect(str(tree.attrName[a])).to.equal("class");
+      expect(str(tree.attrValue[a])).to.equal("x");
+      expect(str(tree.attrName[a + 1])).to.equal("hidden");
+      expect(tree.attrValue[a + 1]).to.equal(-1);
+      var text = tree.firstChild[p];
+      expect(libtidy.nodeTypes[tree.type[text]]).to.equal("Text");
+      expect(str(tree.value[text])).to.equal("foo");
+      var comment = tree.nextSibling[text];
+      expect(libtidy.nodeTypes[tree.type[comment]]).to.equal("Comment");
+      expect(str(tree.value[comment])).to.equal("bar");
+      expect(tree.nextSibling[comment]).to.equal(-1);
+    });
+
   });
 
   describe("basic asynchroneous operation using callback:", function() {
@@ -233,6 +305,88 @@ describe("TidyDoc:", function() {
       });
     });
 
+    it("parse stream", function() {
+      var messages =
+          "line 2 column 7 - Warning: inserting missing 'title' element\n";
+      var doc = new TidyDoc();
+      var input = new stream.PassThrough();
+      var res = doc.parseStream(input).then(function(res) {
+        expect(res).to.not.contain.key("output");
+        expect(res).to.containSubset({
+          errlog: messages,
+        });
+        var out = doc.saveBufferSync().toString();
+        expect(out).to.match(/<p>\s*foo\s*<\/p>/);
+      });
+      // hand over the document in pieces, some of them after a delay
+      input.write(testDoc1.slice(0, 20));
+      setTimeout(function() {
+        input.write(testDoc1.slice(20, 40));
+        input.end(testDoc1.slice(40));
+      }, 10);
+      return res;
+    });
+
+    it("save to stream", function() {
+      var doc = new TidyDoc();
+      doc.optSet("show-body-only", true);
+      doc.parseBufferSync(testDoc1);
+      var chunks = [];
+      var output = new stream.Writable({
+        write: function(chunk, encoding, cb) {
+          chunks.push(chunk);
+          cb();
+        },
+      });
+      return doc.saveStream(output).then(function(res) {
+        expect(res).to.not.contain.key("output");
+        expect(Buffer.concat(chunks).toString()).to.equal("<p>foo</p>\n");
+      });
+    });
+
+    it("parse stream reports stream errors", function() {
+      var doc = new TidyDoc();
+      var input = new stream.PassThrough();
+      var res = doc.parseStream(input).then(function() {
+        throw new Error("should have been rejected");
+      }, function(err) {
+        expect(err.message).to.equal("broken input");
+      });
+      input.write(testDoc1.slice(0, 20));
+      input.emit("error", new Error("broken input"));
+      return res;
+    });
+
+    it("parse stream fails if the input gets destroyed", function() {
+      var doc = new TidyDoc();
+      var input = new stream.PassThrough();
+      var res = doc.parseStream(input).then(function() {
+        throw new Error("should have been rejected");
+      }, function(err) {
+        expect(err.code).to.equal("ERR_STREAM_PREMATURE_CLOSE");
+      });
+      input.write(testDoc1.slice(0, 20));
+      setTimeout(() => input.destroy(), 10);
+      return res;
+    });
+
+    it("save to stream fails if the output fails", function() {
+      var doc = new TidyDoc();
+      doc.parseBufferSync(Buffer("<p>foo</p>\n".repeat(20000)));
+      var output = new stream.Writable({
+        highWaterMark: 1,
+        write: function(chunk, encoding, cb) {
+          setTimeout(() => cb(new Error("broken output")), 10);
+        },
+      });
+      output.on("error", () => {});
+      return doc.saveStream(output).then(function() {
+        throw new Error("should have been rejected");
+      }, function(err) {
+        expect(err.message).to.equal("broken output");
+      });
+    });
+
     it("clean and repair", function() {
       // Can there be any output during clean and repair?
       var messages = "";
@@ -295,6 +449,36 @@ describe("TidyDoc:", function() {
       });
     });
 
+    it("extract attribute values", function() {
+      var doc = new TidyDoc();
+      var input = Buffer('<p><a href="/a">A</a>\n<img src="b.png" alt="B">' +
+                         '<a name="c">C</a></p>');
+      return doc.extract(input, {attrs: ["href", "SRC"]}).then(function(res) {
+        expect(res).to.not.have.property("output");
+        expect(res.extracted).to.deep.equal([
+          {tag: "a", attr: "href", value: "/a", line: 1, column: 4},
+          {tag: "img", attr: "src", value: "b.png", line: 2, column: 1},
+        ]);
+        expect(res.metrics).to.have.all.keys(
+          "parse", "cleanAndRepair", "extract");
+        return doc.extract(null, {tags: ["a"], attrs: ["href", "name"]});
+      }).then(function(res) {
+        expect(res.extracted.map(m => m.value)).to.deep.equal(["/a", "c"]);
+      });
+    });
+
+    it("batch of documents", function() {
+      var doc = new TidyDoc();
+      doc.optSet("force-output", true);
+      return doc.tidyBatch([testDoc1, testDoc2]).then(function(res) {
+        expect(res).to.have.length(2);
+        expect(res[0].errlog).to.match(/Tidy found 1 warning/);
+        expect(res[1].errlog).to.match(/2 errors/);
+        expect(res[1].output).to.have.length.above(100);
+        expect(doc.getErrorLog()).equal("");
+      });
+    });
+
     it("all in one go", function() {
       var doc = new TidyDoc();
       return doc.tidyBuffer(testDoc1).then(function(res) {
@@ -308,6 +492,77 @@ describe("TidyDoc:", function() {
       });
     });
 
+    it("file to file", function() {
+      var input = path.join(os.tmpdir(), "libtidy-in-" + process.pid);
+      var output = path.join(os.tmpdir(), "libtidy-out-" + process.pid);
+      fs.writeFileSync(input, testDoc1);
+      var doc = new TidyDoc();
+      return doc.tidyFile(input, output).then(function(res) {
+        expect(res).not.to.have.property("output");
+        expect(res.outputName).to.equal(output);
+        expect(res.errlog).to.match(/inserting missing/);
+        expect(fs.readFileSync(output, "utf-8"))
+          .to.match(/<title>.*<\/title>/);
+        return doc.tidyFile(input);
+      }).then(function(res) {
+        expect(res.output.toString()).to.match(/<title>.*<\/title>/);
+        fs.unlinkSync(input);
+        fs.unlinkSync(output);
+        return doc.tidyFile(input).then(function() {
+          throw new Error("Missing file was accepted");
+        }, function(err) {
+          expect(err.code).to.equal("ENOENT");
+          expect(err.path).to.equal(input);
+        });
+      });
+    });
+
+    it("in place", function() {
+      var file = path.join(os.tmpdir(), "libtidy-inplace-" + process.pid);
+      fs.writeFileSync(file, "<p>foo");
+      var doc = new TidyDoc();
+      doc.options = {show_body_only: true};
+      var hash;
+      return doc.tidyFile(file, file).then(function(res) {
+        expect(res.outputName).to.equal(file);
+        expect(res).not.to.have.property("unchanged");
+        expect(res.inputHash).to.match(/^[0-9a-f]{16}$/);
+        expect(res.outputHash).not.to.equal(res.inputHash);
+        expect(fs.readFileSync(file, "utf-8")).to.equal("<p>foo</p>\n");
+        hash = res.outputHash;
+        return doc.tidyFile(file, file);
+      }).then(function(res) {
+        expect(res.unchanged).to.be.true;
+        expect(res.inputHash).to.equal(hash);
+        expect(res.outputHash).to.equal(hash);
+        doc.skipHash = hash;
+        return doc.tidyFile(file, file);
+      }).then(function(res) {
+        expect(res.skipped).to.be.true;
+        expect(res.outputName).to.equal(file);
+        expect(fs.readdirSync(os.tmpdir()).filter(
+          name => name.startsWith(path.basename(file) + ".tidy-")))
+          .to.deep.equal([]);
+        fs.unlinkSync(file);
+      });
+    });
+
+    it("reports the output file when writing fails", function() {
+      var input = path.join(os.tmpdir(), "libtidy-in-" + process.pid);
+      var output = path.join(os.tmpdir(), "libtidy-missing-" + process.pid,
+                             "out.html");
+      fs.writeFileSync(input, testDoc1);
+      var doc = new TidyDoc();
+      return doc.tidyFile(input, output).then(function() {
+        throw new Error("Missing directory was accepted");
+      }, function(err) {
+        fs.unlinkSync(input);
+        expect(err.code).to.equal("ENOENT");
+        expect(err.path).to.equal(output);
+        expect(err.tempPath).to.have.string(output);
+      });
+    });
+
   });
 
 });
@@ -3,7 +3,11 @@
 var chai = require("chai");
 chai.use(require("chai-subset"));
 var expect = chai.expect;
+var stream = require("stream");
 var util = require("util");
+var fs = require("fs");
+var os = require("os");
+var path = require("path");
 var libtidy = require("../");
 
 describe("High-level API:", function() {
@@ -47,4 +51,279 @@ describe("High-level API:", function() {
 
   });
 
+  describe("tidyBatch:", function() {
+
+    it("returns one result per document", function() {
+      var docs = [testDoc1, "<p>bar", testDoc1.toString()];
+      return libtidy.tidyBatch(docs, {show_body_only: true}).then(res => {
+        expect(res).to.have.length(3);
+        res.forEach(r => expect(Buffer.isBuffer(r.output)).ok);
+        expect(res[0].output.toString()).to.equal("<p>foo</p>\n");
+        expect(res[1].output.toString()).to.equal("<p>bar</p>\n");
+        expect(res[1].errlog).to.match(/missing <!DOCTYPE>/);
+      });
+    });
+
+    it("handles an empty list", function(done) {
+      libtidy.tidyBatch([], function(err, res) {
+        expect(err).to.be.null;
+        expect(res).to.deep.equal([]);
+        done();
+      });
+    });
+
+  });
+
+  describe("tidyFragments:", function() {
+
+    it("splits the combined document", function() {
+      var frags = ["<p>foo", Buffer("baz"), "<p>\n<b>bar"];
+      return libtidy.tidyFragments(frags).then(res => {
+        expect(res).to.have.length(3);
+        res.forEach(r => expect(r.combined).to.be.true);
+        expect(res[0].output.toString()).to.equal("<p>foo</p>\n");
+        expect(res[1].output.toString()).to.equal("baz\n");
+        expect(res[2].output.toString()).to.match(/<b>bar<\/b>/);
+        expect(libtidy.unpackMessages(res[0].messages)).to.deep.equal([]);
+        var msgs = libtidy.unpackMessages(res[2].messages);
+        expect(msgs).to.containSubset([{line: 2}]);
+        msgs.forEach(m => expect(m.line).to.be.within(1, 2));
+      });
+    });
+
+    it("tidies fragments on their own if one escapes", function() {
+      var frags = ["<p>foo", "</div><p>bar"];
+      return libtidy.tidyFragments(frags).then(res => {
+        res.forEach(r => expect(r.combined).to.be.false);
+        expect(res[0].output.toString()).to.equal("<p>foo</p>\n");
+        expect(res[1].output.toString()).to.equal("<p>bar</p>\n");
+      });
+    });
+
+    it("tidies fragments on their own if comments get hidden", function(done) {
+      libtidy.tidyFragments(["<p>foo"], {hide_comments: true}, (err, res) => {
+        expect(err).to.be.null;
+        expect(res[0].combined).to.be.false;
+        expect(res[0].output.toString()).to.equal("<p>foo</p>\n");
+        var codes = libtidy.unpackMessages(res[0].messages).map(m => m.code);
+        expect(codes).not.to.include("MISSING_DOCTYPE");
+        expect(codes).not.to.include("MISSING_TITLE_ELEMENT");
+        done();
+      });
+    });
+
+  });
+
+  describe("lint:", function() {
+
+    it("reports messages without output", function() {
+      return libtidy.lint("<p>bar").then(res => {
+        expect(res).not.to.have.property("output");
+        expect(res.errlog).to.equal("");
+        var codes = libtidy.unpackMessages(res.messages).map(m => m.code);
+        expect(codes).to.include("MISSING_TITLE_ELEMENT");
+        expect(res.metrics).to.have.all.keys(
+          "parse", "cleanAndRepair", "runDiagnostics");
+      });
+    });
+
+    it("returns one result per document of an array", function(done) {
+      libtidy.lint([testDoc1, "<p>bar"], function(err, res) {
+        expect(err).to.be.null;
+        expect(res).to.have.length(2);
+        res.forEach(r => expect(r).not.to.have.property("output"));
+        var codes = libtidy.unpackMessages(res[1].messages).map(m => m.code);
+        expect(codes).to.include("MISSING_TITLE_ELEMENT");
+        done();
+      });
+    });
+
+  });
+
+  describe("tidyFileQueue:", function() {
+
+    var files;
+
+    beforeEach(function() {
+      files = [];
+      for (var i = 0; i < 5; ++i) {
+        var name = path.join(os.tmpdir(),
+                             `libtidy-queue-${process.pid}-${i}.html`);
+        fs.writeFileSync(name, `<p>${i}`);
+        files.push(name);
+      }
+    });
+
+    afterEach(function() {
+      files.forEach(name => fs.unlinkSync(name));
+    });
+
+    it("keeps the number of concurrent jobs bounded", function() {
+      var seen = [];
+      return libtidy.tidyFileQueue(files, {show_body_only: true}, {
+        concurrency: 2,
+        onFile: (err, res, index) => {
+          expect(err).to.be.null;
+          seen.push(index);
+        },
+      }).then(() => {
+        expect(seen.sort()).to.deep.equal([0, 1, 2, 3, 4]);
+        files.forEach((name, i) =>
+          expect(fs.readFileSync(name, "utf-8")).to.equal(`<p>${i}</p>\n`));
+      });
+    });
+
+    it("works without settings", function() {
+      return libtidy.tidyFileQueue(files, {show_body_only: true}).then(() => {
+        files.forEach((name, i) =>
+          expect(fs.readFileSync(name, "utf-8")).to.equal(`<p>${i}</p>\n`));
+      });
+    });
+
+    it("stops once asked to", function() {
+      var count = 0;
+      return libtidy.tidyFileQueue(files, {}, {
+        concurrency: 1,
+        onFile: () => ++count < 2,
+      }).then(() => {
+        expect(count).to.equal(2);
+      });
+    });
+
+    it("skips files known to be tidy from its manifest", function() {
+      var manifest = path.join(os.tmpdir(),
+                               `libtidy-manifest-${process.pid}.json`);
+      var opts = {show_body_only: true};
+      function run() {
+        var results = [];
+        return libtidy.tidyFileQueue(files, opts, {
+          manifest: manifest,
+          onFile: (err, res, index) => {
+            expect(err).to.be.null;
+            results[index] = res;
+          },
+        }).then(() => results);
+      }
+      return run().then(results => {
+        results.forEach(res => expect(res).not.to.have.property("unchanged"));
+        return run();
+      }).then(results => {
+        results.forEach(res => expect(res.unchanged).to.be.true);
+        fs.writeFileSync(files[2], "<p>changed");
+        return run();
+      }).then(results => {
+        expect(results[2]).not.to.have.property("skipped");
+        expect(fs.readFileSync(files[2], "utf-8"))
+          .to.equal("<p>changed</p>\n");
+        [0, 1, 3, 4].forEach(i => expect(results[i].skipped).to.be.true);
+        opts = {show_body_only: true, indent: true};
+        return run();
+      }).then(results => {
+        results.forEach(res => expect(res).not.to.have.property("skipped"));
+        fs.unlinkSync(manifest);
+      });
+    });
+
+  });
+
+  describe("watchFiles:", function() {
+
+    var file = path.join(os.tmpdir(), `libtidy-watch-${process.pid}.html`);
+
+    afterEach(function() {
+      fs.unlinkSync(file);
+    });
+
+    it("tidies files again once they change", function(done) {
+      fs.writeFileSync(file, "<p>first");
+      var outputs = [];
+      var watcher = libtidy.watchFiles([file], {show_body_only: true}, {
+        delay: 10,
+        onFile: (err, res) => {
+          if (err) return done(err);
+          if (!res.unchanged)
+            outputs.push(fs.readFileSync(file, "utf-8"));
+        },
+      });
+      watcher.on("error", done);
+      watcher.once("idle", () => {
+        fs.writeFileSync(file, "<p>second");
+        watcher.on("idle", () => {
+          if (outputs.length < 2) return;
+          expect(outputs).to.deep.equal(["<p>first</p>\n",
+                                         "<p>second</p>\n"]);
+          watcher.close().then(() => done(), done);
+        });
+      });
+    });
+
+    it("works without settings", function(done) {
+      fs.writeFileSync(file, "<p>first");
+      var watcher = libtidy.watchFiles([file], {show_body_only: true});
+      watcher.on("error", done);
+      watcher.once("idle", () => {
+        expect(fs.readFileSync(file, "utf-8")).to.equal("<p>first</p>\n");
+        watcher.close().then(() => done(), done);
+      });
+    });
+
+    it("reports failing files as errors without onFile", function(done) {
+      fs.writeFileSync(file, "<p>first");
+      var missing = file + ".missing";
+      var watcher = libtidy.watchFiles([file, missing], {});
+      watcher.once("error", err => {
+        expect(err.code).to.equal("ENOENT");
+        watcher.close().then(() => done(), done);
+      });
+    });
+
+  });
+
+  describe("createTidyStream:", function() {
+
+    it("tidies what gets piped through it", function(done) {
+      var input = new stream.PassThrough();
+      var tidy = libtidy.createTidyStream({show_body_only: true});
+      var chunks = [];
+      tidy.on("data", chunk => chunks.push(chunk));
+      tidy.on("error", done);
+      tidy.on("end", function() {
+        expect(Buffer.concat(chunks).toString()).to.equal("<p>foo</p>\n");
+        expect(tidy.errlog).to.match(/inserting missing/);
+        done();
+      });
+      input.pipe(tidy);
+      input.write(testDoc1.slice(0, 30));
+      setTimeout(() => input.end(testDoc1.slice(30)), 10);
+    });
+
+    it("pushes large output in several chunks", function(done) {
+      var big = "<p>foo</p>\n".repeat(10000);
+      var tidy = libtidy.createTidyStream({show_body_only: true});
+      var chunks = [];
+      tidy.on("data", chunk => chunks.push(chunk));
+      tidy.on("error", done);
+      tidy.on("end", function() {
+        expect(chunks.length).to.be.above(1);
+        expect(Buffer.concat(chunks).toString()).to.equal(big);
+        done();
+      });
+      tidy.end(big);
+    });
+
+    it("releases its thread when destroyed", function(done) {
+      var tidy = libtidy.createTidyStream();
+      tidy.write(testDoc1.slice(0, 30));
+      setTimeout(function() {
+        expect(libtidy.poolStats().busy).to.equal(1);
+        tidy.destroy();
+        setTimeout(function() {
+          expect(libtidy.poolStats().busy).to.equal(0);
+          done();
+        }, 50);
+      }, 10);
+    });
+
+  });
+
 });
@@ -0,0 +1,65 @@
+"use strict";
+
+var chai = require("chai");
+var expect = chai.expect;
+var libtidy = require("../");
+var TidyDoc = libtidy.TidyDoc;
+
+describe("Memory accounting:", function() {
+
+  var bigDoc = Buffer('<!DOCTYPE html>\n<html><head></head>\n<body>' +
+                      Array(2001).join('<p>foo <b>bar</b></p>\n') +
+                      '</body></html>');
+
+  var defaults = libtidy.memoryStats();
+
+  afterEach(function() {
+    libtidy.configureMemory({reportThreshold: defaults.reportThreshold});
+  });
+
+  it("reports its state", function() {
+    var stats = libtidy.memoryStats();
+    expect(stats).to.have.all.keys("held", "reported", "reportThreshold");
+    expect(stats.reportThreshold).to.equal(65536);
+  });
+
+  it("keeps unreported changes below the threshold", function() {
+    var doc = TidyDoc();
+    doc.parseBufferSync(bigDoc);
+    var stats = libtidy.memoryStats();
+    expect(Math.abs(stats.held - stats.reported))
+      .to.be.below(stats.reportThreshold);
+  });
+
+  it("counts memory held by a parsed document", function() {
+    var doc = TidyDoc();
+    var before = libtidy.memoryStats().held;
+    doc.parseBufferSync(bigDoc);
+    expect(libtidy.memoryStats().held).to.be.above(before);
+  });
+
+  it("includes memory of asynchroneous jobs", function() {
+    var doc = TidyDoc();
+    var before = libtidy.memoryStats().held;
+    return doc.parseBuffer(bigDoc).then(function() {
+      // the job gets destroyed after its callback returned
+      return new Promise(resolve => setImmediate(resolve));
+    }).then(function() {
+      expect(libtidy.memoryStats().held).to.be.above(before);
+    });
+  });
+
+  it("reports everything with a zero threshold", function() {
+    libtidy.configureMemory({reportThreshold: 0});
+    TidyDoc().parseBufferSync(bigDoc);
+    var stats = libtidy.memoryStats();
+    expect(stats.held).to.equal(stats.reported);
+  });
+
+  it("rejects invalid settings", function() {
+    expect(() => libtidy.configureMemory({reportThreshold: -1}))
+      .to.throw(RangeError);
+    expect(() => libtidy.configureMemory(3)).to.throw(TypeError);
+  });
+
+});
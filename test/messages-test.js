@@ -0,0 +1,77 @@
+"use strict";
+
+var chai = require("chai");
+var expect = chai.expect;
+var libtidy = require("../");
+var TidyDoc = libtidy.TidyDoc;
+
+describe("Structured messages:", function() {
+
+  var testDoc1 = Buffer('<!DOCTYPE html>\n<html><head></head>\n' +
+                        '<body><p>foo</p></body></html>');
+  var testDoc2 = Buffer('<!DOCTYPE html>\n<html><head></head>\n' +
+                        '<body><form><ul><li></form></ul></li>');
+
+  it("are disabled by default", function() {
+    var doc = TidyDoc();
+    doc.parseBufferSync(testDoc1);
+    expect(doc.getMessages()).to.be.null;
+    expect(doc.getErrorLog()).to.match(/missing 'title'/);
+  });
+
+  it("replace the text log", function() {
+    var doc = TidyDoc();
+    doc.collectMessages(true);
+    expect(doc.parseBufferSync(testDoc1)).to.not.match(/missing 'title'/);
+    var msgs = doc.getMessages();
+    expect(msgs.records).to.be.an.instanceof(Int32Array);
+    expect(msgs.records).to.have.length(4 * msgs.codes.length);
+    expect(libtidy.unpackMessages(msgs)).to.deep.equal([{
+      level: "Warning",
+      line: 2,
+      column: 7,
+      code: "MISSING_TITLE_ELEMENT",
+    }]);
+  });
+
+  it("can be filtered by level", function() {
+    var doc = TidyDoc();
+    doc.collectMessages({levels: ["Error"]});
+    doc.parseBufferSync(testDoc2);
+    var list = libtidy.unpackMessages(doc.getMessages());
+    expect(list).to.not.be.empty;
+    list.forEach(msg => expect(msg.level).to.equal("Error"));
+  });
+
+  it("can be filtered by code", function() {
+    var doc = TidyDoc();
+    doc.collectMessages({exclude: ["MISSING_TITLE_ELEMENT"]});
+    doc.parseBufferSync(testDoc1);
+    expect(doc.getMessages().records).to.have.length(0);
+  });
+
+  it("are part of asynchroneous results", function() {
+    var doc = TidyDoc();
+    doc.collectMessages({levels: ["Warning"]});
+    return doc.parseBuffer(testDoc1).then(function(res) {
+      var list = libtidy.unpackMessages(res.messages);
+      expect(list).to.have.length(1);
+      expect(list[0].code).to.equal("MISSING_TITLE_ELEMENT");
+    });
+  });
+
+  it("can be switched off again", function() {
+    var doc = TidyDoc();
+    doc.collectMessages(true);
+    doc.collectMessages(false);
+    expect(doc.parseBufferSync(testDoc1)).to.match(/missing 'title'/);
+    expect(doc.getMessages()).to.be.null;
+  });
+
+  it("reject unknown levels", function() {
+    var doc = TidyDoc();
+    expect(() => doc.collectMessages({levels: ["Nope"]}))
+      .to.throw(RangeError);
+  });
+
+});
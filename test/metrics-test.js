@@ -0,0 +1,59 @@
+"use strict";
+
+var chai = require("chai");
+var expect = chai.expect;
+var libtidy = require("../");
+var TidyDoc = libtidy.TidyDoc;
+
+describe("Metrics:", function() {
+
+  var testDoc1 = Buffer('<!DOCTYPE html>\n<html><head></head>\n' +
+                        '<body><p>foo</p></body></html>');
+
+  afterEach(function() {
+    libtidy.configureMetrics({histogram: false, reset: true});
+  });
+
+  it("come with every asynchroneous result", function() {
+    return TidyDoc().tidyBuffer(testDoc1).then(function(res) {
+      expect(res.metrics).to.have.all.keys(
+        "parse", "cleanAndRepair", "runDiagnostics", "save");
+      expect(res.metrics.parse).to.have.all.keys(
+        "time", "allocations", "bytes");
+      expect(res.metrics.parse.time).to.be.above(0);
+      expect(res.metrics.parse.allocations).to.be.above(0);
+      expect(res.metrics.parse.bytes).to.be.above(0);
+    });
+  });
+
+  it("count the output buffer when saving", function() {
+    var doc = Buffer("<p>" + "foo ".repeat(10000));
+    return TidyDoc().tidyBuffer(doc).then(function(res) {
+      expect(res.metrics.save.bytes).to.be.at.least(res.output.length);
+    });
+  });
+
+  it("only cover the phases which ran", function() {
+    return TidyDoc().parseBuffer(testDoc1).then(function(res) {
+      expect(res.metrics).to.have.all.keys("parse");
+    });
+  });
+
+  it("aggregate into histograms on request", function() {
+    expect(libtidy.metricsStats().histogram).to.be.false;
+    libtidy.configureMetrics({histogram: true, reset: true});
+    return Promise.all([
+      TidyDoc().tidyBuffer(testDoc1),
+      TidyDoc().parseBuffer(testDoc1),
+    ]).then(function() {
+      var stats = libtidy.metricsStats();
+      expect(stats.histogram).to.be.true;
+      expect(stats.parse.count).to.equal(2);
+      expect(stats.save.count).to.equal(1);
+      expect(stats.parse.buckets).to.have.length(32);
+      var sum = stats.parse.buckets.reduce((a, b) => a + b, 0);
+      expect(sum).to.equal(2);
+    });
+  });
+
+});
@@ -7,6 +7,7 @@ var util = require("util");
 var libtidy = require("../");
 var TidyDoc = libtidy.TidyDoc;
 var TidyOption = libtidy.TidyOption;
+var TidyConfig = libtidy.TidyConfig;
 
 describe("TidyOption:", function() {
 
@@ -281,6 +282,85 @@ describe("TidyOption:", function() {
       expect(doc.optGet("tab-size")).to.be.equal(3);
     });
 
+    it("is reused by later accesses", function() {
+      var doc = TidyDoc();
+      expect(doc.options).to.equal(doc.options);
+      expect(TidyDoc().options).to.not.equal(doc.options);
+    });
+
+  });
+
+  describe("bulk access:", function() {
+
+    it("gets all options at once", function() {
+      var doc = TidyDoc();
+      var opts = doc.getOptions();
+      expect(Object.keys(opts).length).to.be.equal(libtidy.optionTable.length);
+      expect(opts).to.containSubset({
+        tab_size: 8,
+        alt_text: null,
+      });
+    });
+
+    it("gets only changed options on request", function() {
+      var doc = TidyDoc();
+      expect(doc.getOptions(true)).to.deep.equal({});
+      doc.optSet("tab-size", 3);
+      doc.optSet("indent", "auto");
+      expect(doc.getOptions(true)).to.deep.equal({
+        tab_size: 3,
+        indent: "auto",
+      });
+    });
+
+    it("sets all options at once", function() {
+      var doc = TidyDoc();
+      doc.setOptions({alt_text: "foo", tabSize: 3});
+      expect(doc.optGet("alt-text")).to.be.equal("foo");
+      expect(doc.optGet("tab-size")).to.be.equal(3);
+    });
+
+    it("changes nothing for an unknown option", function() {
+      var doc = TidyDoc();
+      expect(() => doc.setOptions({tab_size: 3, no_such_option: 1}))
+        .to.throw(/unknown/);
+      expect(doc.optGet("tab-size")).to.be.equal(8);
+    });
+
+    it("is available for configurations", function() {
+      var config = TidyConfig({show_body_only: true});
+      expect(config.getOptions(true)).to.deep.equal({show_body_only: "yes"});
+    });
+
+  });
+
+  describe("the option table:", function() {
+
+    it("describes every option", function() {
+      var doc = TidyDoc();
+      var opts = doc.getOptionList();
+      expect(libtidy.optionTable).to.have.length(opts.length);
+      var tabSize = libtidy.optionTable.filter(function(opt) {
+        return opt.name == "tab-size";
+      })[0];
+      var opt = doc.getOption("tab-size");
+      expect(tabSize).to.deep.equal({
+        id: opt.id,
+        name: "tab-size",
+        key: "tab_size",
+        category: opt.category,
+        type: "integer",
+        default: 8,
+        readOnly: false,
+        pickList: [],
+      });
+    });
+
+    it("is immutable", function() {
+      expect(Object.isFrozen(libtidy.optionTable)).to.be.true;
+      expect(Object.isFrozen(libtidy.optionTable[0])).to.be.true;
+    });
+
   });
 
 });
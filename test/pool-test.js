@@ -0,0 +1,207 @@
+"use strict";
+
+var chai = require("chai");
+chai.use(require("chai-subset"));
+var expect = chai.expect;
+var libtidy = require("../");
+var TidyDoc = libtidy.TidyDoc;
+
+describe("Worker pool:", function() {
+
+  var testDoc1 = Buffer('<!DOCTYPE html>\n<html><head></head>\n' +
+                        '<body><p>foo</p></body></html>');
+
+  var defaults = libtidy.poolStats();
+
+  afterEach(function() {
+    libtidy.configurePool({threads: defaults.threads, maxQueue: 0});
+  });
+
+  it("reports its state", function() {
+    var stats = libtidy.poolStats();
+    expect(stats).to.have.all.keys(
+      "threads", "running", "busy", "queued",
+      "maxQueue", "completed", "rejected");
+    expect(stats.threads).to.be.above(0);
+    expect(stats.maxQueue).to.equal(0);
+  });
+
+  it("counts completed jobs", function() {
+    var before = libtidy.poolStats().completed;
+    return TidyDoc().tidyBuffer(testDoc1).then(function(res) {
+      expect(res.output.toString()).to.match(/<title>.*<\/title>/);
+      expect(libtidy.poolStats().completed).to.be.above(before);
+    });
+  });
+
+  it("can fall back to the libuv threadpool", function() {
+    libtidy.configurePool({threads: 0});
+    expect(libtidy.poolStats().threads).to.equal(0);
+    return TidyDoc().tidyBuffer(testDoc1).then(function(res) {
+      expect(res.output.toString()).to.match(/<title>.*<\/title>/);
+    });
+  });
+
+  it("rejects jobs once the queue is full", function() {
+    libtidy.configurePool({threads: 1, maxQueue: 1});
+    var jobs = [];
+    var rejected = 0;
+    for (var i = 0; i < 5; ++i) {
+      jobs.push(TidyDoc().tidyBuffer(testDoc1).catch(function(err) {
+        expect(err.message).to.match(/queue is full/);
+        ++rejected;
+      }));
+    }
+    return Promise.all(jobs).then(function() {
+      expect(rejected).to.be.above(0);
+      expect(libtidy.poolStats().rejected).to.be.at.least(rejected);
+    });
+  });
+
+  it("queues a batch a few documents at a time", function() {
+    libtidy.configurePool({threads: 1, maxQueue: 4});
+    var inputs = [];
+    for (var i = 0; i < 20; ++i)
+      inputs.push(testDoc1);
+    var res = TidyDoc().tidyBatch(inputs);
+    var stats = libtidy.poolStats();
+    expect(stats.queued + stats.busy).to.be.at.most(2);
+    return res.then(function(res) {
+      expect(res).to.have.length(20);
+      res.forEach(r => expect(r.output.toString())
+                  .to.match(/<title>.*<\/title>/));
+    });
+  });
+
+  it("prefers jobs with higher priority", function() {
+    libtidy.configurePool({threads: 1});
+    var order = [];
+    var first = TidyDoc(), low = TidyDoc(), high = TidyDoc();
+    high.priority = 5;
+    return Promise.all([
+      first.tidyBuffer(testDoc1),
+      low.tidyBuffer(testDoc1).then(() => order.push("low")),
+      high.tidyBuffer(testDoc1).then(() => order.push("high")),
+    ]).then(function() {
+      expect(order).to.deep.equal(["high", "low"]);
+    });
+  });
+
+  describe("budgets:", function() {
+
+    var bigDoc = Buffer('<!DOCTYPE html>\n<html><head></head>\n<body>' +
+                        '<table><tr><td><b><i>x'.repeat(50000) +
+                        '</body></html>');
+
+    it("abort a job", function() {
+      var doc = TidyDoc();
+      var res = doc.tidyBuffer(bigDoc);
+      expect(doc.abort()).to.be.true;
+      return res.then(function() {
+        throw Error("Job should have been aborted");
+      }, function(err) {
+        expect(err.code).to.equal("ABORT_ERR");
+        expect(doc.abort()).to.be.false;
+        return doc.tidyBuffer(testDoc1);
+      }).then(function(res) {
+        expect(res.output.toString()).to.match(/<title>.*<\/title>/);
+      });
+    });
+
+    it("abort a job once a signal fires", function() {
+      var doc = TidyDoc();
+      doc.signal = {
+        aborted: true,
+        addEventListener: function() {},
+        removeEventListener: function() {},
+      };
+      return doc.tidyBuffer(testDoc1).then(function() {
+        throw Error("Job should have been aborted");
+      }, function(err) {
+        expect(err.code).to.equal("ABORT_ERR");
+      });
+    });
+
+    it("abort a batch once a signal fires", function() {
+      var doc = TidyDoc();
+      var listener = null;
+      doc.signal = {
+        aborted: false,
+        addEventListener: function(type, cb) { listener = cb; },
+        removeEventListener: function() { listener = null; },
+      };
+      var res = doc.tidyBatch([bigDoc, bigDoc]);
+      doc.signal.aborted = true;
+      listener();
+      return res.then(function() {
+        throw Error("Batch should have been aborted");
+      }, function(err) {
+        expect(err.code).to.equal("ABORT_ERR");
+        expect(listener).to.be.null;
+      });
+    });
+
+    it("stop a job exceeding its time budget", function() {
+      var doc = TidyDoc();
+      doc.timeout = 1;
+      return doc.tidyBuffer(bigDoc).then(function() {
+        throw Error("Job should have timed out");
+      }, function(err) {
+        expect(err.code).to.equal("ETIMEDOUT");
+      });
+    });
+
+    it("stop a job exceeding its memory limit", function() {
+      var doc = TidyDoc();
+      doc.memoryLimit = 1024 * 1024;
+      return doc.tidyBuffer(bigDoc).then(function() {
+        throw Error("Job should have run out of memory");
+      }, function(err) {
+        expect(err.code).to.equal("ENOMEM");
+        expect(err.message).to.match(/memory limit exceeded/);
+        doc.memoryLimit = 0;
+        return doc.tidyBuffer(testDoc1);
+      }).then(function(res) {
+        expect(res.output.toString()).to.match(/<title>.*<\/title>/);
+      });
+    });
+
+  });
+
+  it("serves worker threads", function() {
+    var workerThreads;
+    try {
+      workerThreads = require("worker_threads");
+    } catch (e) {
+      this.skip();
+    }
+    var code =
+      "var wt = require('worker_threads');\n" +
+      "var libtidy = require(wt.workerData.lib);\n" +
+      "libtidy.tidyBuffer(wt.workerData.doc).then(function(res) {\n" +
+      "  wt.parentPort.postMessage(res.output.toString());\n" +
+      "});\n";
+    var workers = [1, 2].map(function() {
+      return new Promise(function(resolve, reject) {
+        var w = new workerThreads.Worker(code, {
+          eval: true,
+          workerData: {lib: require.resolve("../"), doc: testDoc1},
+        });
+        w.on("message", resolve);
+        w.on("error", reject);
+      });
+    });
+    return Promise.all(workers.concat(TidyDoc().tidyBuffer(testDoc1)))
+      .then(function(res) {
+        expect(res[0]).to.match(/<title>.*<\/title>/);
+        expect(res[1]).to.equal(res[0]);
+        expect(res[2].output.toString()).to.equal(res[0]);
+      });
+  });
+
+  it("rejects invalid settings", function() {
+    expect(() => libtidy.configurePool({threads: -1})).to.throw(RangeError);
+    expect(() => libtidy.configurePool(3)).to.throw(TypeError);
+  });
+
+});